@@ -25,15 +25,67 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <limits.h>
+#include <math.h>
+#include <ctype.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <ucontext.h>
+#include <link.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <getopt.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <linux/perf_event.h>
+#include <linux/magic.h>
+#include <x86intrin.h>
+#include <cpuid.h>
+#include <gnu/libc-version.h>
+
+#include "Trace.h"
 
 int success = 0;
 int failure = 0;
 
+// --fast: no pacing and stdout buffered in memory, flushed in batches
+int fast_mode = 0;
+char report_buffer[1 << 16];
+
+// --jobs: results of the forked worker running the current suite
+struct worker_result {
+    int cases;
+    int success;
+    int failure;
+};
+
+struct worker_result *worker_slot = NULL;
+int case_index = 0;
+int case_skip = 0;
+
 /*
 Setups
 */
 
-#define SLEEP_200MS do { usleep(150 * 1000); } while (0)
+#define SLEEP_200MS do { if (!fast_mode) usleep(150 * 1000); } while (0)
+
+// Invalid user input is a usage error, not a broken invariant
+void option_error(const char *name, const char *value, const char *reason)
+{
+    printf("Invalid value for --%s: [%s]%s%s!\n", name, value, reason ? ": " : "",
+           reason ? reason : "");
+    exit(1);
+}
 
 // Catch SIGSEGV and SIGBUS etc...
 void signal_handler(int signum)
@@ -45,6 +97,20 @@ void signal_handler(int signum)
     exit(signum);
 }
 
+// Publish the progress of a worker, and skip the cases a crashed worker already ran
+#define CASE_START \
+    do { \
+        case_index++; \
+        if (worker_slot != NULL) { \
+            worker_slot->cases = case_index; \
+            worker_slot->success = success; \
+            worker_slot->failure = failure; \
+        } \
+        if (case_index <= case_skip) \
+            return; \
+        arena_reset(&test_arena); \
+    } while (0)
+
 #define NOT_NULL(v) (assert((v) != NULL))
 #define LOAD_SYM(sym, symname) \
     { \
@@ -62,7 +128,8 @@ void signal_handler(int signum)
         printf("|------------|" \
                " Running test suite for: [%s] " \
                "|------------|\n\n", suite_name); \
-        f(); \
+        run_suite(f, suite_name); \
+        fflush(stdout); \
     } while (0)
 
 #define TEST_HEADER \
@@ -89,14 +156,256 @@ int (*my_ffs)(int) = NULL;
 char *(*my_memfrob)(char *, size_t) = NULL;
 char *(*my_strfry)(char *) = NULL;
 
+/*
+Libraries
+Every library given with --lib gets its own table of the SYMBOLS below,
+swapped into the my_* pointers before its suites run
+*/
+
+struct symbol {
+    char *name;
+    void **sym;
+};
+
+static const struct symbol SYMBOLS[] = {
+    {"strlen", (void **)&my_strlen},
+    {"strchr", (void **)&my_strchr},
+    {"strrchr", (void **)&my_strrchr},
+    {"memcpy", (void **)&my_memcpy},
+    {"memset", (void **)&my_memset},
+    {"strcmp", (void **)&my_strcmp},
+    {"memmove", (void **)&my_memmove},
+    {"strncmp", (void **)&my_strncmp},
+    {"strcasecmp", (void **)&my_strcasecmp},
+    {"strstr", (void **)&my_strstr},
+    {"strpbrk", (void **)&my_strpbrk},
+    {"strcspn", (void **)&my_strcspn},
+    {"ffs", (void **)&my_ffs},
+    {"memfrob", (void **)&my_memfrob},
+    {"strfry", (void **)&my_strfry},
+};
+
+#define NB_SYMBOLS (sizeof(SYMBOLS) / sizeof(SYMBOLS[0]))
+#define MAX_LIBRARIES 16
+
+struct library {
+    char *path;
+    void *handle;
+    void *syms[NB_SYMBOLS];
+    int success;
+    int failure;
+    int failures[NB_SYMBOLS];
+};
+
+struct library libraries[MAX_LIBRARIES];
+int nb_libraries = 0;
+int current_library = 0;
+
+/*
+Comparison contracts
+The C standard only fixes the sign of strcmp, strncmp and strcasecmp.
+exact: the same value as glibc, sign: the same sign,
+glibc: the difference of the first differing bytes, as glibc computes it
+*/
+
+enum {
+    CMP_EXACT,
+    CMP_SIGN,
+    CMP_GLIBC,
+};
+
+enum {
+    CMP_STRCMP,
+    CMP_STRNCMP,
+    CMP_STRCASECMP,
+};
+
+static const char *CMP_NAMES[] = {"exact", "sign", "glibc"};
+
+struct cmp_contract {
+    char *funcname;
+    int contract;
+};
+
+struct cmp_contract CONTRACTS[] = {
+    {"strcmp", CMP_SIGN},
+    {"strncmp", CMP_SIGN},
+    {"strcasecmp", CMP_SIGN},
+};
+
+static int byte_difference(const char *s1, const char *s2, size_t n, int fold)
+{
+    for (size_t i = 0; i < n; i++) {
+        int c1 = (unsigned char)s1[i];
+        int c2 = (unsigned char)s2[i];
+        if (fold) {
+            c1 = tolower(c1);
+            c2 = tolower(c2);
+        }
+        if (c1 != c2 || c1 == '\0') {
+            return c1 - c2;
+        }
+    }
+    return 0;
+}
+
+static int cmp_accepts(int contract, int got, int libc, int reference)
+{
+    switch (contract) {
+    case CMP_SIGN:
+        return (got > 0) - (got < 0) == (libc > 0) - (libc < 0);
+    case CMP_GLIBC:
+        return got == reference;
+    default:
+        return got == libc;
+    }
+}
+
+int same_strcmp(int got, const char *s1, const char *s2)
+{
+    int contract = CONTRACTS[CMP_STRCMP].contract;
+
+    return cmp_accepts(contract, got, strcmp(s1, s2),
+                       contract == CMP_GLIBC ? byte_difference(s1, s2, SIZE_MAX, 0) : 0);
+}
+
+int same_strncmp(int got, const char *s1, const char *s2, size_t n)
+{
+    int contract = CONTRACTS[CMP_STRNCMP].contract;
+
+    return cmp_accepts(contract, got, strncmp(s1, s2, n),
+                       contract == CMP_GLIBC ? byte_difference(s1, s2, n, 0) : 0);
+}
+
+int same_strcasecmp(int got, const char *s1, const char *s2)
+{
+    int contract = CONTRACTS[CMP_STRCASECMP].contract;
+
+    return cmp_accepts(contract, got, strcasecmp(s1, s2),
+                       contract == CMP_GLIBC ? byte_difference(s1, s2, SIZE_MAX, 1) : 0);
+}
+
+// "sign" for all of them, or "strcmp=exact,strcasecmp=glibc"
+void parse_contracts(char *arg)
+{
+    for (char *item = strtok(arg, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *value = strchr(item, '=');
+        int contract = -1;
+        if (value != NULL) {
+            *value++ = '\0';
+        }
+        for (int i = 0; i < 3; i++) {
+            if (strcmp(value ? value : item, CMP_NAMES[i]) == 0) {
+                contract = i;
+            }
+        }
+        if (contract == -1) {
+            printf("Unknown comparison contract: [%s]!\n", value ? value : item);
+            exit(1);
+        }
+        int matched = 0;
+        for (unsigned int i = 0; i < sizeof(CONTRACTS) / sizeof(CONTRACTS[0]); i++) {
+            if (value == NULL || strcmp(CONTRACTS[i].funcname, item) == 0) {
+                CONTRACTS[i].contract = contract;
+                matched = 1;
+            }
+        }
+        if (!matched) {
+            printf("Unknown comparison function: [%s]!\n", item);
+            exit(1);
+        }
+    }
+}
+
+/*
+Test arena
+The buffers of a test case are carved out of one reserved mapping and given back
+at the start of the next case, so millions of cases never reach malloc.
+Each buffer is aligned on --arena-align bytes plus --arena-offset,
+and followed by --arena-redzone bytes of a known pattern that the asserts check.
+*/
+
+#define ARENA_SIZE ((size_t)1 << 30)
+#define ARENA_BLOCKS 64
+#define ARENA_POISON 0xA5
+
+struct arena {
+    char *base;
+    size_t size;
+    size_t used;
+    size_t align;
+    size_t offset;
+    size_t redzone;
+    size_t nb_blocks;
+    char *ends[ARENA_BLOCKS];
+};
+
+struct arena test_arena = {NULL, ARENA_SIZE, 0, 64, 0, 16, 0, {NULL}};
+
+// Zeroed buffer of size bytes, valid until the next arena_reset()
+void *arena_alloc(struct arena *a, size_t size)
+{
+    if (a->base == NULL) {
+        a->base = mmap(NULL, a->size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (a->base == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+    }
+    size_t start = (a->used + a->align - 1) / a->align * a->align + a->offset;
+    if (a->nb_blocks == ARENA_BLOCKS || start + size + a->redzone > a->size) {
+        printf("\x1B[31mTest arena exhausted by a %lu bytes buffer\n\e[0m", size);
+        exit(1);
+    }
+    char *block = a->base + start;
+    memset(block, 0, size);
+    memset(block + size, ARENA_POISON, a->redzone);
+    a->ends[a->nb_blocks++] = block + size;
+    a->used = start + size + a->redzone;
+    return block;
+}
+
+char *arena_strdup(struct arena *a, const char *s)
+{
+    size_t len = strlen(s) + 1;
+
+    return memcpy(arena_alloc(a, len), s, len);
+}
+
+// Index of the first buffer whose redzone was written to, or -1
+int arena_overflow(struct arena *a)
+{
+    for (size_t i = 0; i < a->nb_blocks; i++) {
+        for (size_t j = 0; j < a->redzone; j++) {
+            if ((unsigned char)a->ends[i][j] != ARENA_POISON) {
+                printf("\tOverflow: [buffer %lu written %lu bytes past its end]\n", i, j + 1);
+                return (int)i;
+            }
+        }
+    }
+    return -1;
+}
+
+void arena_reset(struct arena *a)
+{
+    a->used = 0;
+    a->nb_blocks = 0;
+}
+
 void setup()
 {
     TEST_HEADER;
     printf("--> Setting up tests...\n");
     SLEEP_200MS;
-    printf("--> Setting up printf automatic flush...\n");
-    SLEEP_200MS;
-    assert(setvbuf(stdout, NULL, _IONBF, 0) == 0);
+    if (fast_mode) {
+        printf("--> Setting up buffered output...\n");
+        assert(setvbuf(stdout, report_buffer, _IOFBF, sizeof(report_buffer)) == 0);
+    } else {
+        printf("--> Setting up printf automatic flush...\n");
+        SLEEP_200MS;
+        assert(setvbuf(stdout, NULL, _IONBF, 0) == 0);
+    }
     printf("--> Setting up random seed to 42...\n");
     SLEEP_200MS;
     srand(42);
@@ -109,38 +418,153 @@ void setup()
     signal(SIGFPE, signal_handler);
     signal(SIGPIPE, signal_handler);
     signal(SIGSYS, signal_handler);
+    printf("--> Setting up comparison contracts:");
+    for (unsigned int i = 0; i < sizeof(CONTRACTS) / sizeof(CONTRACTS[0]); i++) {
+        printf(" %s [%s]", CONTRACTS[i].funcname, CMP_NAMES[CONTRACTS[i].contract]);
+    }
+    printf("\n");
+    printf("--> Setting up test arena: align [%lu] offset [%lu] redzone [%lu]\n",
+           test_arena.align, test_arena.offset, test_arena.redzone);
 
     SLEEP_200MS;
 }
 
-void unload_library(void)
+void unload_library(struct library *lib)
 {
-    printf("\n\n--> Unloading library\n");
-    dlclose(handler);
+    printf("\n\n--> Unloading library [%s]\n", lib->path);
+    dlclose(lib->handle);
 }
 
-void load_library(void)
+void load_library(struct library *lib)
 {
-    printf("\n\n--> Loading library [./libasm.so]\n");
-    NOT_NULL(handler = dlopen("./libasm.so", RTLD_LAZY | RTLD_DEEPBIND | RTLD_NOW));
-    LOAD_SYM(my_strlen, "strlen");
-    LOAD_SYM(my_strchr, "strchr");
-    LOAD_SYM(my_strrchr, "strrchr");
-    LOAD_SYM(my_memcpy, "memcpy");
-    LOAD_SYM(my_memset, "memset");
-    LOAD_SYM(my_strcmp, "strcmp");
-    LOAD_SYM(my_memmove, "memmove");
-    LOAD_SYM(my_strncmp, "strncmp");
-    LOAD_SYM(my_strcasecmp, "strcasecmp");
-    LOAD_SYM(my_strstr, "strstr");
-    LOAD_SYM(my_strpbrk, "strpbrk");
-    LOAD_SYM(my_strcspn, "strcspn");
-    LOAD_SYM(my_ffs, "ffs");
-    LOAD_SYM(my_memfrob, "memfrob");
-    LOAD_SYM(my_strfry, "strfry");
+    printf("\n\n--> Loading library [%s]\n", lib->path);
+    NOT_NULL(handler = dlopen(lib->path, RTLD_LAZY | RTLD_DEEPBIND | RTLD_NOW));
+    lib->handle = handler;
+    for (unsigned int i = 0; i < NB_SYMBOLS; i++) {
+        LOAD_SYM(lib->syms[i], SYMBOLS[i].name);
+    }
     puts("");
 }
 
+// Point the my_* functions to the symbols of a library
+void use_library(int index)
+{
+    current_library = index;
+    handler = libraries[index].handle;
+    for (unsigned int i = 0; i < NB_SYMBOLS; i++) {
+        *SYMBOLS[i].sym = libraries[index].syms[i];
+    }
+    if (nb_libraries > 1) {
+        printf("|============| Library [%s] |============|\n\n", libraries[index].path);
+    }
+}
+
+void add_library(char *path)
+{
+    if (nb_libraries == MAX_LIBRARIES) {
+        printf("At most %d libraries can be compared!\n", MAX_LIBRARIES);
+        exit(1);
+    }
+    libraries[nb_libraries++].path = path;
+}
+
+// Index in SYMBOLS of a function, -1 if it has none
+int symbol_index(const char *funcname)
+{
+    for (unsigned int i = 0; i < NB_SYMBOLS; i++) {
+        if (strcmp(SYMBOLS[i].name, funcname) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Kept per function so that the rankings can show which libraries are wrong
+void library_suite_done(const char *funcname, int failures)
+{
+    int index = symbol_index(funcname);
+
+    if (index >= 0) {
+        libraries[current_library].failures[index] += failures;
+    }
+}
+
+/*
+Code fingerprints
+A hash of the machine code of each symbol, to tell which functions
+changed between two builds of a library
+*/
+
+struct code_segment {
+    uintptr_t addr;
+    uintptr_t end;
+};
+
+static int find_code_segment(struct dl_phdr_info *info, size_t size, void *data)
+{
+    struct code_segment *seg = data;
+
+    (void)size;
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+        uintptr_t start = info->dlpi_addr + ph->p_vaddr;
+        if (ph->p_type == PT_LOAD && (ph->p_flags & PF_X)
+            && seg->addr >= start && seg->addr < start + ph->p_memsz) {
+            seg->end = start + ph->p_memsz;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// The ELF size of the symbol, or when the assembler left it at 0,
+// the distance to the next symbol of the table or to the end of the segment
+size_t symbol_code_size(const struct library *lib, unsigned int index)
+{
+    uintptr_t addr = (uintptr_t)lib->syms[index];
+    const ElfW(Sym) *sym = NULL;
+    Dl_info info;
+
+    if (addr == 0) {
+        return 0;
+    }
+    if (dladdr1((void *)addr, &info, (void **)&sym, RTLD_DL_SYMENT) && sym != NULL
+        && sym->st_size > 0) {
+        return sym->st_size;
+    }
+    struct code_segment seg = {addr, addr};
+    dl_iterate_phdr(find_code_segment, &seg);
+    for (unsigned int i = 0; i < NB_SYMBOLS; i++) {
+        uintptr_t next = (uintptr_t)lib->syms[i];
+        if (next > addr && next < seg.end) {
+            seg.end = next;
+        }
+    }
+    return seg.end - addr;
+}
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// 0 when the symbol is missing
+uint64_t symbol_fingerprint(const struct library *lib, unsigned int index)
+{
+    size_t size = symbol_code_size(lib, index);
+
+    if (size == 0) {
+        return 0;
+    }
+    uint64_t hash = fnv1a(14695981039346656037ULL, &size, sizeof(size));
+    return fnv1a(hash, lib->syms[index], size);
+}
+
 void show_score()
 {
     TEST_HEADER;
@@ -159,6 +583,7 @@ and use them in the tests section
 
 void assert_strlen(char const *test)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%s)]\n", test);
     size_t res1 = my_strlen(test);
@@ -176,6 +601,7 @@ void assert_strlen(char const *test)
 
 void assert_strchr(const char *s, int c)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%s), (%c)]\n", s, c);
     char *res1 = my_strchr(s, c);
@@ -193,6 +619,7 @@ void assert_strchr(const char *s, int c)
 
 void assert_strrchr(const char *s, int c)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%s), (%c)]\n", s, c);
     char *res1 = my_strrchr(s, c);
@@ -210,10 +637,11 @@ void assert_strrchr(const char *s, int c)
 
 void assert_memset(size_t size_to_test)
 {
-    char buf1[BUFSIZ] = {0};
-    char buf2[BUFSIZ] = {0};
+    CASE_START;
+    char *buf1 = arena_alloc(&test_arena, size_to_test);
+    char *buf2 = arena_alloc(&test_arena, size_to_test);
 
-    for (size_t i = 0; i < BUFSIZ; i++) {
+    for (size_t i = 0; i < size_to_test; i++) {
         int c = rand() % 256;
         buf1[i] = c;
         buf2[i] = c;
@@ -225,11 +653,11 @@ void assert_memset(size_t size_to_test)
     printf("=============\n");
     printf("\tTesting:  [(%lu)]\n", size_to_test);
     int res1 = memcmp(buf1, buf2, size_to_test);
-    if (res1 != 0) {
-        printf("\tGot:      [%d]\n", memcmp(buf1, buf2, BUFSIZ));
-        printf("\t   ->:    ["); write(1, buf1, size_to_test); printf("]\n");
+    if (res1 != 0 || arena_overflow(&test_arena) != -1) {
+        printf("\tGot:      [%d]\n", memcmp(buf1, buf2, size_to_test));
+        printf("\t   ->:    ["); fwrite(buf1, 1, size_to_test, stdout); printf("]\n");
         printf("\tExpected: [%d]\n", 0);
-        printf("\t   ->:    ["); write(1, buf2, size_to_test); printf("]\n");
+        printf("\t   ->:    ["); fwrite(buf2, 1, size_to_test, stdout); printf("]\n");
         failure++;
     } else {
         success++;
@@ -240,19 +668,21 @@ void assert_memset(size_t size_to_test)
 
 void assert_memcpy(void *right, size_t size, size_t size_to_test)
 {
-    char buf1[BUFSIZ] = {0};
-    char buf2[BUFSIZ] = {0};
+    CASE_START;
+    size_t size_array = size > size_to_test ? size : size_to_test;
+    char *buf1 = arena_alloc(&test_arena, size_array);
+    char *buf2 = arena_alloc(&test_arena, size_array);
 
     my_memcpy(buf1, right, size);
     memcpy(buf2, right, size);
     printf("=============\n");
     printf("\tTesting:  [(%p), (%lu), (%lu)]\n", right, size, size_to_test);
     int res1 = memcmp(buf1, buf2, size_to_test);
-    if (res1 != 0) {
-        printf("\tGot:      [%d]\n", memcmp(buf1, buf2, BUFSIZ));
-        printf("\t   ->:    ["); write(1, buf1, size_to_test); printf("]\n");
+    if (res1 != 0 || arena_overflow(&test_arena) != -1) {
+        printf("\tGot:      [%d]\n", memcmp(buf1, buf2, size_array));
+        printf("\t   ->:    ["); fwrite(buf1, 1, size_to_test, stdout); printf("]\n");
         printf("\tExpected: [%d]\n", 0);
-        printf("\t   ->:    ["); write(1, buf2, size_to_test); printf("]\n");
+        printf("\t   ->:    ["); fwrite(buf2, 1, size_to_test, stdout); printf("]\n");
         failure++;
     } else {
         success++;
@@ -263,13 +693,14 @@ void assert_memcpy(void *right, size_t size, size_t size_to_test)
 
 void assert_strcmp(const char *s1, const char *s2)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%s), (%s)]\n", s1, s2);
     int res1 = my_strcmp(s1, s2);
     int res2 = strcmp(s1, s2);
-    if (res2 != res1) {
+    if (!same_strcmp(res1, s1, s2)) {
         printf("\tGot:      [%d]\n", res1);
-        printf("\tExpected: [%d]\n", res2);
+        printf("\tExpected: [%d] (%s)\n", res2, CMP_NAMES[CONTRACTS[CMP_STRCMP].contract]);
         failure++;
     } else {
         success++;
@@ -280,16 +711,17 @@ void assert_strcmp(const char *s1, const char *s2)
 
 void assert_memmove(size_t size, size_t offset1, size_t offset2)
 {
+    CASE_START;
     size_t size_array = size + offset1 + offset2;
-    char *buf1 = calloc(size_array, sizeof(char));
-    char *buf2 = calloc(size_array, sizeof(char));
-    char *buf3 = calloc(size_array, sizeof(char));
-    char *buf4 = calloc(size_array, sizeof(char));
+    char *buf1 = arena_alloc(&test_arena, size_array);
+    char *buf2 = arena_alloc(&test_arena, size_array);
+    char *buf3 = arena_alloc(&test_arena, size_array);
+    char *buf4 = arena_alloc(&test_arena, size_array);
 
-    char *mbuf1 = calloc(size_array, sizeof(char));
-    char *mbuf2 = calloc(size_array, sizeof(char));
-    char *mbuf3 = calloc(size_array, sizeof(char));
-    char *mbuf4 = calloc(size_array, sizeof(char));
+    char *mbuf1 = arena_alloc(&test_arena, size_array);
+    char *mbuf2 = arena_alloc(&test_arena, size_array);
+    char *mbuf3 = arena_alloc(&test_arena, size_array);
+    char *mbuf4 = arena_alloc(&test_arena, size_array);
 
     for (size_t i = 0; i < size_array; i++) {
         char visible[] = {'a', 'b', 'c', 'd', 'e'};
@@ -318,38 +750,35 @@ void assert_memmove(size_t size, size_t offset1, size_t offset2)
     int res2 = memcmp(mbuf2, buf2, size_array);
     int res3 = memcmp(mbuf3, buf3, size_array);
     int res4 = memcmp(mbuf4, buf4, size_array);
-    if (res1 != 0 || res2 != 0 || res3 != 0 || res4 != 0) {
+    if (res1 != 0 || res2 != 0 || res3 != 0 || res4 != 0 || arena_overflow(&test_arena) != -1) {
         printf("\tGot:      [%d, %d, %d, %d]\n", res1, res2, res3, res4);
-        printf("\t   ->:    ["); write(1, mbuf1, size_array); printf("]\n");
-        printf("\t   ->:    ["); write(1, mbuf2, size_array); printf("]\n");
-        printf("\t   ->:    ["); write(1, mbuf3, size_array); printf("]\n");
-        printf("\t   ->:    ["); write(1, mbuf4, size_array); printf("]\n");
+        printf("\t   ->:    ["); fwrite(mbuf1, 1, size_array, stdout); printf("]\n");
+        printf("\t   ->:    ["); fwrite(mbuf2, 1, size_array, stdout); printf("]\n");
+        printf("\t   ->:    ["); fwrite(mbuf3, 1, size_array, stdout); printf("]\n");
+        printf("\t   ->:    ["); fwrite(mbuf4, 1, size_array, stdout); printf("]\n");
         printf("\tExpected: [%d, %d, %d, %d]\n", 0, 0, 0, 0);
-        printf("\t   ->:    ["); write(1, buf1, size_array); printf("]\n");
-        printf("\t   ->:    ["); write(1, buf2, size_array); printf("]\n");
-        printf("\t   ->:    ["); write(1, buf3, size_array); printf("]\n");
-        printf("\t   ->:    ["); write(1, buf4, size_array); printf("]\n");
+        printf("\t   ->:    ["); fwrite(buf1, 1, size_array, stdout); printf("]\n");
+        printf("\t   ->:    ["); fwrite(buf2, 1, size_array, stdout); printf("]\n");
+        printf("\t   ->:    ["); fwrite(buf3, 1, size_array, stdout); printf("]\n");
+        printf("\t   ->:    ["); fwrite(buf4, 1, size_array, stdout); printf("]\n");
         failure++;
     } else {
         success++;
     }
-    free(buf1);
-    free(buf2);
-    free(buf3);
-    free(buf4);
     SLEEP_200MS;
 }
 
 void assert_strncmp(const char *s1, const char *s2, size_t n)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%s), (%s), (%lu)]\n", s1, s2, n);
     int res1 = my_strncmp(s1, s2, n);
     int res2 = strncmp(s1, s2, n);
 
-    if (res2 != res1) {
+    if (!same_strncmp(res1, s1, s2, n)) {
         printf("\tGot:      [%d]\n", res1);
-        printf("\tExpected: [%d]\n", res2);
+        printf("\tExpected: [%d] (%s)\n", res2, CMP_NAMES[CONTRACTS[CMP_STRNCMP].contract]);
         failure++;
     } else {
         success++;
@@ -360,13 +789,14 @@ void assert_strncmp(const char *s1, const char *s2, size_t n)
 
 void assert_strcasecmp(const char *s1, const char *s2)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%s), (%s)]\n", s1, s2);
     int res1 = my_strcasecmp(s1, s2);
     int res2 = strcasecmp(s1, s2);
-    if (res2 != res1) {
+    if (!same_strcasecmp(res1, s1, s2)) {
         printf("\tGot:      [%d]\n", res1);
-        printf("\tExpected: [%d]\n", res2);
+        printf("\tExpected: [%d] (%s)\n", res2, CMP_NAMES[CONTRACTS[CMP_STRCASECMP].contract]);
         failure++;
     } else {
         success++;
@@ -376,6 +806,7 @@ void assert_strcasecmp(const char *s1, const char *s2)
 
 void assert_strstr(const char *s1, const char *s2)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%s), (%s)]\n", s1, s2);
     char *res1 = my_strstr(s1, s2);
@@ -393,6 +824,7 @@ void assert_strstr(const char *s1, const char *s2)
 
 void assert_strpbrk(const char *s1, const char *s2)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%s), (%s)]\n", s1, s2);
     char *res1 = my_strpbrk(s1, s2);
@@ -410,6 +842,7 @@ void assert_strpbrk(const char *s1, const char *s2)
 
 void assert_strcspn(const char *s1, const char *s2)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%s), (%s)]\n", s1, s2);
     size_t res1 = my_strcspn(s1, s2);
@@ -427,6 +860,7 @@ void assert_strcspn(const char *s1, const char *s2)
 
 void assert_ffs(int test)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%d)]\n", test);
     int res1 = my_ffs(test);
@@ -444,8 +878,9 @@ void assert_ffs(int test)
 
 void assert_memfrob(void *ptr, size_t n, size_t real_size)
 {
-    char *buf = malloc(real_size);
-    char *mbuf = malloc(real_size);
+    CASE_START;
+    char *buf = arena_alloc(&test_arena, real_size);
+    char *mbuf = arena_alloc(&test_arena, real_size);
 
     memcpy(buf, ptr, real_size);
     mempcpy(mbuf, ptr, real_size);
@@ -453,15 +888,14 @@ void assert_memfrob(void *ptr, size_t n, size_t real_size)
     printf("\tTesting:  [(%lu)]\n",n);
     char *res1 = my_memfrob(mbuf, n);
     char *res2 = memfrob(buf, n);
-    if (memcmp(res1, res2, real_size) != 0) {
-        printf("\tGot:      ["); write(1, res1, real_size); printf("]\n");
-        printf("\tExpected: ["); write(1, res2, real_size); printf("]\n");
+    if (memcmp(res1, res2, real_size) != 0 || arena_overflow(&test_arena) != -1) {
+        printf("\tGot:      ["); fwrite(res1, 1, real_size, stdout); printf("]\n");
+        printf("\tExpected: ["); fwrite(res2, 1, real_size, stdout); printf("]\n");
         failure++;
     } else {
         success++;
     }
     printf("=============\n\n");
-    free(buf);
     SLEEP_200MS;
 }
 
@@ -480,12 +914,13 @@ static int is_anagram(const char *s1, const char *s2)
 
 void assert_strfry(char *s)
 {
+    CASE_START;
     printf("=============\n");
     printf("\tTesting:  [(%s)]\n", s);
-    char *old = strdup(s);
+    char *old = arena_strdup(&test_arena, s);
     char *res1 = my_strfry(old);
 
-    if (is_anagram(res1, s) == 0) {
+    if (is_anagram(res1, s) == 0 || arena_overflow(&test_arena) != -1) {
         printf("\tExpected: [An anagram result: (%s) -- (%s)]\n", res1, s);
         failure++;
     } else if (strcmp(res1, s) == 0 && strlen(s) > 1) {
@@ -495,7 +930,6 @@ void assert_strfry(char *s)
     }
     printf("=============\n\n");
     SLEEP_200MS;
-    free(old);
 }
 
 /*
@@ -774,6 +1208,236 @@ void tests_strfry()
     free(str);
 }
 
+/*
+
+Result cache
+Results of the suites and benchmarks saved with --results, keyed by the machine
+code of the function, the harness binary and the settings that change them.
+A function whose key is already in the file is not run again
+
+*/
+
+#define RESULT_CACHE_VERSION 1
+#define RESULT_VALUES 14
+
+struct result_entry {
+    char kind;          // 'T' for a test suite, 'B' for a benchmark size
+    uint64_t key;
+    char funcname[32];
+    size_t size;
+    int mode;
+    double values[RESULT_VALUES];
+};
+
+char *result_cache_path = NULL;
+FILE *result_cache_file = NULL;
+struct result_entry *result_entries = NULL;
+size_t nb_result_entries = 0;
+uint64_t result_harness = 0;
+int result_hits = 0;
+
+static void result_add(const struct result_entry *e)
+{
+    if ((nb_result_entries & (nb_result_entries - 1)) == 0) {
+        size_t capacity = nb_result_entries ? nb_result_entries * 2 : 64;
+        NOT_NULL(result_entries = realloc(result_entries, capacity * sizeof(*result_entries)));
+    }
+    result_entries[nb_result_entries++] = *e;
+}
+
+// Hash of the harness itself, so that changing a suite invalidates its results
+static uint64_t result_harness_hash(void)
+{
+    uint64_t hash = fnv1a(14695981039346656037ULL, "minilibc-results", 16);
+    FILE *exe = fopen("/proc/self/exe", "r");
+    char buf[BUFSIZ];
+    size_t len;
+
+    NOT_NULL(exe);
+    while ((len = fread(buf, 1, sizeof(buf), exe)) > 0) {
+        hash = fnv1a(hash, buf, len);
+    }
+    fclose(exe);
+    return hash;
+}
+
+// A missing or outdated cache file is started again from scratch. A damaged line, such as
+// the one an interrupted write leaves without its newline, is skipped and not the rest
+void result_cache_open(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    struct result_entry e;
+    char line[1024];
+    int version = 0;
+    int skipped = 0;
+    int ended = 1;
+
+    result_harness = result_harness_hash();
+    if (file != NULL && fscanf(file, "minilibc-results %d\n", &version) == 1
+        && version == RESULT_CACHE_VERSION) {
+        while (fgets(line, sizeof(line), file) != NULL) {
+            char *p = line;
+            int len = 0;
+            int i = 0;
+            ended = strchr(line, '\n') != NULL;
+            if (sscanf(p, " %c %lx %31s %lu %d%n", &e.kind, &e.key, e.funcname, &e.size,
+                       &e.mode, &len) == 5) {
+                for (p += len; i < RESULT_VALUES && sscanf(p, "%lf%n", &e.values[i], &len) == 1;
+                     p += len) {
+                    i++;
+                }
+            }
+            if (i == RESULT_VALUES && ended && strspn(p, " \n") == strlen(p)) {
+                result_add(&e);
+            } else {
+                skipped++;
+            }
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    result_cache_file = fopen(path, version == RESULT_CACHE_VERSION ? "a" : "w");
+    if (result_cache_file == NULL) {
+        printf("\x1B[31m--> Could not open result cache [%s]: %s\n\e[0m", path, strerror(errno));
+        exit(1);
+    }
+    if (version != RESULT_CACHE_VERSION) {
+        fprintf(result_cache_file, "minilibc-results %d\n", RESULT_CACHE_VERSION);
+    } else if (!ended) {
+        fprintf(result_cache_file, "\n");
+    }
+    if (skipped > 0) {
+        printf("\x1B[33m--> Skipped %d damaged lines of result cache [%s]\n\e[0m", skipped, path);
+    }
+    printf("--> Loaded %lu results from cache [%s]\n", nb_result_entries, path);
+}
+
+// Written right away, so that an interrupted run still keeps what it finished
+void result_store(const struct result_entry *e)
+{
+    if (result_cache_file == NULL || e->key == 0) {
+        return;
+    }
+    result_add(e);
+    fprintf(result_cache_file, "%c %016lx %s %lu %d", e->kind, e->key, e->funcname, e->size,
+            e->mode);
+    for (int i = 0; i < RESULT_VALUES; i++) {
+        fprintf(result_cache_file, " %.17g", e->values[i]);
+    }
+    fprintf(result_cache_file, "\n");
+    fflush(result_cache_file);
+}
+
+const struct result_entry *result_find(char kind, uint64_t key, const char *funcname,
+                                       size_t size, int mode)
+{
+    if (result_cache_file == NULL || key == 0) {
+        return NULL;
+    }
+    for (size_t i = nb_result_entries; i-- > 0;) {
+        const struct result_entry *e = &result_entries[i];
+        if (e->kind == kind && e->key == key && e->size == size && e->mode == mode
+            && strcmp(e->funcname, funcname) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// 0, never cached, when the cache is off or the current library lacks the symbol
+uint64_t result_key(const char *funcname, const void *settings, size_t settings_size)
+{
+    for (unsigned int i = 0; result_cache_file != NULL && i < NB_SYMBOLS; i++) {
+        if (strcmp(SYMBOLS[i].name, funcname) == 0) {
+            uint64_t code = symbol_fingerprint(&libraries[current_library], i);
+            if (code == 0) {
+                return 0;
+            }
+            uint64_t hash = fnv1a(result_harness, &code, sizeof(code));
+            hash = fnv1a(hash, funcname, strlen(funcname));
+            return fnv1a(hash, settings, settings_size);
+        }
+    }
+    return 0;
+}
+
+// The contracts and the arena change what the suites accept. Only the code of the symbol
+// itself is hashed: local helpers and tables outside its range are not
+static uint64_t result_suite_key(const char *funcname)
+{
+    struct {
+        int contracts[sizeof(CONTRACTS) / sizeof(CONTRACTS[0])];
+        size_t arena[3];
+    } settings;
+
+    memset(&settings, 0, sizeof(settings));
+    for (unsigned int i = 0; i < sizeof(CONTRACTS) / sizeof(CONTRACTS[0]); i++) {
+        settings.contracts[i] = CONTRACTS[i].contract;
+    }
+    settings.arena[0] = test_arena.align;
+    settings.arena[1] = test_arena.offset;
+    settings.arena[2] = test_arena.redzone;
+    return result_key(funcname, &settings, sizeof(settings));
+}
+
+const struct result_entry *result_find_suite(const char *funcname)
+{
+    return result_find('T', result_suite_key(funcname), funcname, 0, 0);
+}
+
+// Add the counts of a cached suite to the score
+void result_reuse_suite(FILE *out, const struct result_entry *e)
+{
+    success += e->values[0];
+    failure += e->values[1];
+    result_hits++;
+    fprintf(out, "\tCached:      [code unchanged] Success: [\x1B[32m%d\e[0m] "
+            "Failure: [\x1B[31m%d\e[0m]\n\n", (int)e->values[0], (int)e->values[1]);
+}
+
+void result_store_suite(const char *funcname, int suite_success, int suite_failure)
+{
+    struct result_entry e = {'T', result_suite_key(funcname), "", 0, 0, {0}};
+
+    snprintf(e.funcname, sizeof(e.funcname), "%s", funcname);
+    e.values[0] = suite_success;
+    e.values[1] = suite_failure;
+    result_store(&e);
+}
+
+void result_cache_close(void)
+{
+    if (result_cache_file == NULL) {
+        return;
+    }
+    printf("--> Reused %d results from cache [%s]\n", result_hits, result_cache_path);
+    fclose(result_cache_file);
+    free(result_entries);
+}
+
+// Suites are named like "strchr/index" after the symbol they test. With a cache,
+// each one starts from the same seed so that skipping the others does not change it
+void run_suite(void (*f)(void), const char *suite_name)
+{
+    const struct result_entry *cached;
+    char funcname[32];
+    int before_success = success;
+    int before_failure = failure;
+
+    snprintf(funcname, sizeof(funcname), "%.*s", (int)strcspn(suite_name, "/"), suite_name);
+    if (result_cache_file == NULL) {
+        f();
+    } else if ((cached = result_find_suite(funcname)) != NULL) {
+        result_reuse_suite(stdout, cached);
+    } else {
+        srand(42);
+        f();
+        result_store_suite(funcname, success - before_success, failure - before_failure);
+    }
+    library_suite_done(funcname, failure - before_failure);
+}
+
 void run_tests()
 {
     RUN_TEST_SUITE(tests_strlen, "strlen");
@@ -817,6 +1481,17 @@ static const struct funcs FUNCS[] = {
     {tests_strfry, "strfry"},
 };
 
+// True if no function names were given, or if funcname is one of them
+int is_selected(const char *funcname, int ac, char **av)
+{
+    for (int i = 0; i < ac; i++) {
+        if (strcmp(funcname, av[i]) == 0) {
+            return 1;
+        }
+    }
+    return ac == 0;
+}
+
 void chose_specific_test(char *funcname)
 {
     for (unsigned int i = 0; i < sizeof(FUNCS) / sizeof(FUNCS[0]); i++) {
@@ -825,7 +1500,8 @@ void chose_specific_test(char *funcname)
                    " Running specific test suite for [%s]\n"
                    "|--------------------------------------------------------|\n\n", FUNCS[i].funcname); \
             SLEEP_200MS;
-            FUNCS[i].f();
+            run_suite(FUNCS[i].f, FUNCS[i].funcname);
+            fflush(stdout);
             return;
         }
     }
@@ -833,16 +1509,5294 @@ void chose_specific_test(char *funcname)
 
 }
 
-int main(int ac, char **av)
+/*
+
+Isolated runs
+Each suite runs in a forked worker, up to --jobs at a time.
+When a case crashes, it is counted as a failure and the suite
+is restarted in a new worker right after it
+
+*/
+
+int jobs = 0;
+
+struct suite_run {
+    const struct funcs *suite;
+    FILE *out;
+    pid_t pid;
+    int skip;
+    int done;
+    int success;
+    int failure;
+};
+
+static void start_worker(struct suite_run *run, struct worker_result *slot)
 {
-    setup();
-    load_library();
-    if (ac == 1)
-        run_tests();
-    else
-        for (int i = 1; i < ac; i++)
-            chose_specific_test(av[i]);
-    unload_library();
+    memset(slot, 0, sizeof(*slot));
+    // The suites reused from the cache have unflushed output a crashing worker would repeat
+    fflush(NULL);
+    run->pid = fork();
+    assert(run->pid != -1);
+    if (run->pid != 0) {
+        return;
+    }
+    dup2(fileno(run->out), STDOUT_FILENO);
+    worker_slot = slot;
+    success = 0;
+    failure = 0;
+    case_index = 0;
+    case_skip = run->skip;
+    // Same seed as run_suite, so cached results do not depend on the order of the suites
+    if (result_cache_file != NULL) {
+        srand(42);
+    }
+    if (run->skip == 0) {
+        printf("|------------|"
+               " Running test suite for: [%s] "
+               "|------------|\n\n", run->suite->funcname);
+    }
+    run->suite->f();
+    fflush(stdout);
+    slot->cases = case_index;
+    slot->success = success;
+    slot->failure = failure;
+    _exit(0);
+}
+
+static void worker_done(struct suite_run *run, struct worker_result *slot, int status)
+{
+    int signum = WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status);
+
+    success += slot->success;
+    failure += slot->failure;
+    run->success += slot->success;
+    run->failure += slot->failure;
+    run->done = 1;
+    if (signum == 0) {
+        return;
+    }
+    failure++;
+    run->failure++;
+    fprintf(run->out, "\x1B[31mCase #%d of [%s] crashed with signal %d\n\n\e[0m",
+            slot->cases, run->suite->funcname, signum);
+    fflush(run->out);
+    if (slot->cases > run->skip) {
+        run->skip = slot->cases;
+        run->done = 0;
+    }
+}
+
+static void print_finished_runs(struct suite_run *runs, int nb_runs, int *printed)
+{
+    char buf[BUFSIZ];
+    size_t len;
+
+    for (; *printed < nb_runs && runs[*printed].done; (*printed)++) {
+        FILE *out = runs[*printed].out;
+        rewind(out);
+        while ((len = fread(buf, 1, sizeof(buf), out)) > 0) {
+            fwrite(buf, 1, len, stdout);
+        }
+        fclose(out);
+        fflush(stdout);
+    }
+}
+
+void run_isolated(int ac, char **av)
+{
+    struct suite_run runs[sizeof(FUNCS) / sizeof(FUNCS[0])] = {0};
+    struct worker_result *slots = mmap(NULL, sizeof(runs) / sizeof(*runs) * sizeof(*slots),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    int nb_runs = 0;
+    int running = 0;
+    int printed = 0;
+
+    assert(slots != MAP_FAILED);
+    for (unsigned int i = 0; i < sizeof(FUNCS) / sizeof(FUNCS[0]); i++) {
+        int selected = is_selected(FUNCS[i].funcname, ac, av);
+        for (int j = 0; j < nb_runs && ac == 0; j++) {
+            selected &= runs[j].suite->f != FUNCS[i].f;
+        }
+        if (selected) {
+            runs[nb_runs].suite = &FUNCS[i];
+            NOT_NULL(runs[nb_runs].out = tmpfile());
+            const struct result_entry *cached = result_find_suite(FUNCS[i].funcname);
+            if (cached != NULL) {
+                fprintf(runs[nb_runs].out, "|------------| Running test suite for: [%s] "
+                        "|------------|\n\n", FUNCS[i].funcname);
+                result_reuse_suite(runs[nb_runs].out, cached);
+                runs[nb_runs].failure = cached->values[1];
+                runs[nb_runs].done = 1;
+            }
+            nb_runs++;
+        }
+    }
+    for (int j = 0; j < ac; j++) {
+        int found = 0;
+        for (int i = 0; i < nb_runs; i++) {
+            found |= strcmp(runs[i].suite->funcname, av[j]) == 0;
+        }
+        if (!found) {
+            printf("No such test: [%s]!\n", av[j]);
+        }
+    }
+    printf("--> Running %d suites on %d workers\n\n", nb_runs, jobs);
+    print_finished_runs(runs, nb_runs, &printed);
+    while (printed < nb_runs) {
+        int status;
+        int i = 0;
+        for (; i < nb_runs && running < jobs; i++) {
+            if (!runs[i].done && runs[i].pid == 0) {
+                start_worker(&runs[i], &slots[i]);
+                running++;
+            }
+        }
+        pid_t pid = wait(&status);
+        assert(pid != -1);
+        running--;
+        for (i = 0; runs[i].pid != pid; i++);
+        runs[i].pid = 0;
+        worker_done(&runs[i], &slots[i], status);
+        if (runs[i].done) {
+            result_store_suite(runs[i].suite->funcname, runs[i].success, runs[i].failure);
+        }
+        print_finished_runs(runs, nb_runs, &printed);
+    }
+    for (int i = 0; i < nb_runs; i++) {
+        library_suite_done(runs[i].suite->funcname, runs[i].failure);
+    }
+    munmap(slots, sizeof(runs) / sizeof(*runs) * sizeof(*slots));
+}
+
+/*
+
+Measurement engine
+Pin the process, warm up, calibrate the iteration count, take several samples,
+drop the outliers and give a median with a bootstrap confidence interval
+
+*/
+
+typedef void (*measure_loop_t)(void *fn, void *arg, size_t iters);
+
+struct measurement {
+    double median;
+    double lo;
+    double hi;
+    double cycles;
+    size_t iters;
+    int kept;
+    int noisy;
+};
+
+#define MEASURE_MAX_SAMPLES 256
+#define MEASURE_BOOTSTRAP 1000
+
+int measure_cpu = -1;
+int measure_samples = 21;
+uint64_t measure_target_ns = 20 * 1000 * 1000;
+uint64_t measure_warmup_ns = 2 * 1000 * 1000;
+double measure_noise = 0.05;
+uint64_t measure_seed = 42;
+
+static uint64_t measure_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// xorshift64*, so the bootstrap does not disturb rand() used by the tests
+static uint64_t measure_random(void)
+{
+    measure_seed ^= measure_seed >> 12;
+    measure_seed ^= measure_seed << 25;
+    measure_seed ^= measure_seed >> 27;
+    return measure_seed * 0x2545F4914F6CDD1DULL;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Expects a sorted array
+static double quantile(const double *sorted, int n, double q)
+{
+    double pos = q * (n - 1);
+    int i = (int)pos;
+
+    if (i + 1 >= n) {
+        return sorted[n - 1];
+    }
+    return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+}
+
+// CPUs the process may run on, saved before measure_pin narrows them down to one
+cpu_set_t measure_allowed;
+int measure_allowed_saved = 0;
+
+void measure_save_allowed(void)
+{
+    if (!measure_allowed_saved) {
+        measure_allowed_saved =
+            sched_getaffinity(0, sizeof(measure_allowed), &measure_allowed) == 0;
+    }
+}
+
+void measure_pin(void)
+{
+    cpu_set_t set;
+
+    measure_save_allowed();
+    if (measure_cpu < 0) {
+        measure_cpu = sched_getcpu();
+    }
+    CPU_ZERO(&set);
+    CPU_SET(measure_cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        printf("\x1B[31m--> Could not pin to CPU %d\n\e[0m", measure_cpu);
+        return;
+    }
+    printf("--> Pinned to CPU %d\n", measure_cpu);
+}
+
+// Tukey fences: only keep the samples inside [Q1 - 1.5 IQR, Q3 + 1.5 IQR]
+static int reject_outliers(double *ns, double *cycles, int n)
+{
+    double sorted[MEASURE_MAX_SAMPLES];
+    int kept = 0;
+
+    memcpy(sorted, ns, n * sizeof(*ns));
+    qsort(sorted, n, sizeof(*sorted), compare_doubles);
+    double q1 = quantile(sorted, n, 0.25);
+    double q3 = quantile(sorted, n, 0.75);
+    double low = q1 - 1.5 * (q3 - q1);
+    double high = q3 + 1.5 * (q3 - q1);
+    for (int i = 0; i < n; i++) {
+        if (ns[i] >= low && ns[i] <= high) {
+            ns[kept] = ns[i];
+            cycles[kept] = cycles[i];
+            kept++;
+        }
+    }
+    return kept;
+}
+
+static void bootstrap_median(const double *samples, int n, double *lo, double *hi)
+{
+    static double medians[MEASURE_BOOTSTRAP];
+    double resample[MEASURE_MAX_SAMPLES];
+
+    for (int b = 0; b < MEASURE_BOOTSTRAP; b++) {
+        for (int i = 0; i < n; i++) {
+            resample[i] = samples[measure_random() % n];
+        }
+        qsort(resample, n, sizeof(*resample), compare_doubles);
+        medians[b] = quantile(resample, n, 0.5);
+    }
+    qsort(medians, MEASURE_BOOTSTRAP, sizeof(*medians), compare_doubles);
+    *lo = quantile(medians, MEASURE_BOOTSTRAP, 0.025);
+    *hi = quantile(medians, MEASURE_BOOTSTRAP, 0.975);
+}
+
+// Median and confidence interval of the samples left once the outliers are dropped
+void measure_summary(double *ns, double *cycles, int samples, size_t iters, struct measurement *m)
+{
+    m->iters = iters;
+    m->kept = reject_outliers(ns, cycles, samples);
+    bootstrap_median(ns, m->kept, &m->lo, &m->hi);
+    qsort(ns, m->kept, sizeof(*ns), compare_doubles);
+    qsort(cycles, m->kept, sizeof(*cycles), compare_doubles);
+    m->median = quantile(ns, m->kept, 0.5);
+    m->cycles = quantile(cycles, m->kept, 0.5);
+    m->noisy = m->kept < samples / 2 || (m->hi - m->lo) > measure_noise * m->median;
+}
+
+void measure(measure_loop_t loop, void *fn, void *arg, struct measurement *m)
+{
+    double ns[MEASURE_MAX_SAMPLES];
+    double cycles[MEASURE_MAX_SAMPLES];
+    int samples = measure_samples;
+    uint64_t sample_ns = measure_target_ns / samples;
+    uint64_t elapsed = 0;
+    size_t iters = 1;
+
+    // Calibration doubles as the warmup
+    for (uint64_t start = measure_now_ns();
+         measure_now_ns() - start < measure_warmup_ns || elapsed < sample_ns;) {
+        uint64_t t = measure_now_ns();
+        loop(fn, arg, iters);
+        elapsed = measure_now_ns() - t;
+        if (elapsed < sample_ns && iters < (1UL << 40)) {
+            iters *= 2;
+        }
+    }
+    for (int i = 0; i < samples; i++) {
+        uint64_t t = measure_now_ns();
+        uint64_t c = __rdtsc();
+        loop(fn, arg, iters);
+        cycles[i] = (double)(__rdtsc() - c) / iters;
+        ns[i] = (double)(measure_now_ns() - t) / iters;
+    }
+    measure_summary(ns, cycles, samples, iters, m);
+}
+
+// -1 if a is significantly faster than b, 1 if slower, 0 if the intervals overlap
+int measure_compare(const struct measurement *a, const struct measurement *b)
+{
+    if (a->hi < b->lo) {
+        return -1;
+    }
+    if (a->lo > b->hi) {
+        return 1;
+    }
+    return 0;
+}
+
+/*
+
+Hardware counters
+One perf_event_open group per call series, counting user space only.
+Counters the kernel or the machine refuses are left out
+
+*/
+
+enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_NB,
+};
+
+struct perf_group {
+    int fds[PERF_NB];
+    int index[PERF_NB];
+    int opened;
+};
+
+struct perf_counts {
+    double values[PERF_NB];
+    int valid[PERF_NB];
+};
+
+static const struct {
+    char *name;
+    uint32_t type;
+    uint64_t config;
+} PERF_EVENTS[PERF_NB] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"L1D misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"LLC misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+int perf_mode = 0;
+struct perf_group perf = {{0}, {0}, 0};
+
+// 0 when even the cycles counter is unavailable, the caller then goes without
+int perf_open(struct perf_group *g)
+{
+    struct perf_event_attr attr;
+
+    g->opened = 0;
+    for (int i = 0; i < PERF_NB; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_EVENTS[i].type;
+        attr.config = PERF_EVENTS[i].config;
+        attr.disabled = i == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        g->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : g->fds[0], 0);
+        if (g->fds[i] == -1) {
+            printf("\x1B[33m--> Counter [%s] unavailable: %s\n\e[0m",
+                   PERF_EVENTS[i].name, strerror(errno));
+            if (i == 0) {
+                return 0;
+            }
+            g->index[i] = -1;
+            continue;
+        }
+        g->index[i] = g->opened++;
+    }
+    return 1;
+}
+
+void perf_close(struct perf_group *g)
+{
+    for (int i = 0; i < PERF_NB; i++) {
+        if (g->fds[i] != -1) {
+            close(g->fds[i]);
+        }
+    }
+}
+
+// Counts are scaled up when the kernel had to multiplex the group
+void perf_count(struct perf_group *g, measure_loop_t loop, void *fn, void *arg,
+    size_t iters, struct perf_counts *counts)
+{
+    uint64_t buf[3 + PERF_NB];
+
+    ioctl(g->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(g->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    loop(fn, arg, iters);
+    ioctl(g->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    memset(counts, 0, sizeof(*counts));
+    if (read(g->fds[0], buf, sizeof(buf)) < (ssize_t)(3 * sizeof(*buf)) || buf[2] == 0) {
+        return;
+    }
+    double scale = (double)buf[1] / buf[2];
+    for (int i = 0; i < PERF_NB; i++) {
+        if (g->index[i] != -1) {
+            counts->values[i] = buf[3 + g->index[i]] * scale / iters;
+            counts->valid[i] = 1;
+        }
+    }
+}
+
+static void print_perf_value(const struct perf_counts *c, int counter, double div)
+{
+    if (c->valid[counter]) {
+        printf("%8.3f", c->values[counter] / div);
+    } else {
+        printf("%8s", "n/a");
+    }
+}
+
+void print_perf_row(size_t size, const struct perf_counts *mine, const struct perf_counts *libc)
+{
+    const struct perf_counts *both[] = {mine, libc};
+    double per_byte = size ? size : 1;
+
+    printf("%10s |", "");
+    for (int i = 0; i < 2; i++) {
+        printf(" IPC ");
+        print_perf_value(both[i], PERF_INSTRUCTIONS, both[i]->values[PERF_CYCLES]);
+        printf(" br-miss ");
+        print_perf_value(both[i], PERF_BRANCH_MISSES, 1);
+        printf(" L1D/B ");
+        print_perf_value(both[i], PERF_L1D_MISSES, per_byte);
+        printf(" LLC/B ");
+        print_perf_value(both[i], PERF_LLC_MISSES, per_byte);
+        printf(i == 0 ? " | glibc" : "\n");
+    }
+}
+
+/*
+
+Baselines
+Benchmark results saved to a file (--save-baseline) and compared by a later
+run (--baseline): a function regresses when even the most favorable ends of
+the two confidence intervals differ by more than --threshold percent
+
+*/
+
+#define BASELINE_VERSION 1
+
+struct baseline_entry {
+    char funcname[32];
+    size_t size;
+    double median;
+    double lo;
+    double hi;
+    double libc;
+};
+
+struct baseline {
+    struct baseline_entry *entries;
+    size_t nb;
+    size_t capacity;
+};
+
+struct baseline baseline_old = {NULL, 0, 0};
+struct baseline baseline_new = {NULL, 0, 0};
+char *baseline_path = NULL;
+char *baseline_save_path = NULL;
+double baseline_threshold = 0.05;
+int regressions = 0;
+
+static void baseline_add(struct baseline *b, const struct baseline_entry *e)
+{
+    if (b->nb == b->capacity) {
+        b->capacity = b->capacity ? b->capacity * 2 : 64;
+        NOT_NULL(b->entries = realloc(b->entries, b->capacity * sizeof(*b->entries)));
+    }
+    b->entries[b->nb++] = *e;
+}
+
+void baseline_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    struct baseline_entry e;
+    int version = 0;
+
+    if (file == NULL) {
+        printf("\x1B[31m--> Could not open baseline [%s]: %s\n\e[0m", path, strerror(errno));
+        exit(1);
+    }
+    if (fscanf(file, "minilibc-baseline %d\n", &version) != 1 || version != BASELINE_VERSION) {
+        printf("\x1B[31m--> Baseline [%s] is not a version %d baseline\n\e[0m",
+               path, BASELINE_VERSION);
+        exit(1);
+    }
+    while (fscanf(file, "%31s %lu %lf %lf %lf %lf\n", e.funcname, &e.size,
+                  &e.median, &e.lo, &e.hi, &e.libc) == 6) {
+        baseline_add(&baseline_old, &e);
+    }
+    fclose(file);
+    printf("--> Loaded %lu results from baseline [%s], threshold %.1f%%\n",
+           baseline_old.nb, path, baseline_threshold * 100);
+}
+
+void baseline_save(const char *path)
+{
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        printf("\x1B[31m--> Could not write baseline [%s]: %s\n\e[0m", path, strerror(errno));
+        return;
+    }
+    fprintf(file, "minilibc-baseline %d\n", BASELINE_VERSION);
+    for (size_t i = 0; i < baseline_new.nb; i++) {
+        struct baseline_entry *e = &baseline_new.entries[i];
+        fprintf(file, "%s %lu %.4f %.4f %.4f %.4f\n", e->funcname, e->size,
+                e->median, e->lo, e->hi, e->libc);
+    }
+    fclose(file);
+    printf("--> Saved %lu results to baseline [%s]\n", baseline_new.nb, path);
+}
+
+static const struct baseline_entry *baseline_find(const char *funcname, size_t size)
+{
+    for (size_t i = 0; i < baseline_old.nb; i++) {
+        if (baseline_old.entries[i].size == size
+            && strcmp(baseline_old.entries[i].funcname, funcname) == 0) {
+            return &baseline_old.entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Record a result, and compare it with the loaded baseline if there is one
+void baseline_check(const char *funcname, size_t size, const struct measurement *mine,
+    const struct measurement *libc)
+{
+    struct baseline_entry e = {"", size, mine->median, mine->lo, mine->hi, libc->median};
+    const struct baseline_entry *old = baseline_find(funcname, size);
+
+    snprintf(e.funcname, sizeof(e.funcname), "%s", funcname);
+    baseline_add(&baseline_new, &e);
+    if (old == NULL) {
+        return;
+    }
+    double change = (e.median - old->median) / old->median;
+    double slower = (e.lo - old->hi) / old->median;
+    double faster = (old->lo - e.hi) / old->median;
+    if (slower > baseline_threshold) {
+        printf("%10s   \x1B[31mRegression: %+.1f%% against the baseline (at least %+.1f%%)\n\e[0m",
+               "", change * 100, slower * 100);
+        regressions++;
+    } else if (faster > baseline_threshold) {
+        printf("%10s   \x1B[32mImprovement: %+.1f%% against the baseline\n\e[0m",
+               "", change * 100);
+    }
+}
+
+void baseline_report(void)
+{
+    if (baseline_save_path != NULL) {
+        baseline_save(baseline_save_path);
+    }
+    if (baseline_path != NULL) {
+        printf("--> %s%d regression(s)\e[0m against baseline [%s]\n",
+               regressions ? "\x1B[31m" : "\x1B[32m", regressions, baseline_path);
+    }
+    free(baseline_old.entries);
+    free(baseline_new.entries);
+}
+
+/*
+
+Benchmarks
+Time every loaded symbol against the glibc one on the same input
+for each size of the sweep (--bench)
+
+*/
+
+int bench_mode = 0;
+size_t bench_max = 4 << 20;
+
+struct bench_ctx {
+    char *s1;
+    char *s2;
+    size_t n;
+    int c;
+    size_t zero;
+};
+
+struct bench {
+    char *funcname;
+    void **sym;
+    void *libc;
+    void (*prepare)(struct bench_ctx *, size_t);
+    measure_loop_t loop;
+    measure_loop_t chain;
+    void *noop;
+    int sized;
+};
+
+char *bench_buf1 = NULL;
+char *bench_buf2 = NULL;
+
+// Strings only made of letters so the searched characters are never found
+static void fill_letters(char *buf, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = 'a' + i % 26;
+    }
+    buf[n] = '\0';
+}
+
+static void prepare_string(struct bench_ctx *ctx, size_t n)
+{
+    fill_letters(ctx->s1, n);
+    ctx->n = n;
+    ctx->c = '#';
+}
+
+static void prepare_strings(struct bench_ctx *ctx, size_t n)
+{
+    fill_letters(ctx->s1, n);
+    fill_letters(ctx->s2, n);
+    ctx->n = n;
+}
+
+static void prepare_strcasecmp(struct bench_ctx *ctx, size_t n)
+{
+    prepare_strings(ctx, n);
+    for (size_t i = 0; i < n; i += 2) {
+        ctx->s2[i] -= 'a' - 'A';
+    }
+}
+
+static void prepare_accept(struct bench_ctx *ctx, size_t n)
+{
+    fill_letters(ctx->s1, n);
+    strcpy(ctx->s2, "#$%&");
+    ctx->n = n;
+}
+
+static void prepare_buffers(struct bench_ctx *ctx, size_t n)
+{
+    memset(ctx->s1, 0, n);
+    for (size_t i = 0; i < n; i++) {
+        ctx->s2[i] = rand() % 256;
+    }
+    ctx->n = n;
+    ctx->c = 'e';
+}
+
+static void prepare_ffs(struct bench_ctx *ctx, size_t n)
+{
+    (void)n;
+    ctx->n = 0;
+    ctx->c = 1 << 20;
+}
+
+// The chain variant makes each call wait for the previous one: its first
+// argument depends on the previous result through ctx->zero, always 0
+#define BENCH_LOOP(name, call) \
+    static void bench_loop_##name(void *fn, void *arg, size_t iters) \
+    { \
+        __typeof__(my_##name) f = fn; \
+        struct bench_ctx *ctx = arg; \
+        const size_t dep = 0; \
+        for (size_t i = 0; i < iters; i++) { \
+            call; \
+        } \
+    } \
+    static void bench_chain_##name(void *fn, void *arg, size_t iters) \
+    { \
+        __typeof__(my_##name) f = fn; \
+        struct bench_ctx *ctx = arg; \
+        size_t dep = 0; \
+        for (size_t i = 0; i < iters; i++) { \
+            dep = (size_t)(call) & ctx->zero; \
+        } \
+    }
+
+BENCH_LOOP(strlen, f(ctx->s1 + dep))
+BENCH_LOOP(strchr, f(ctx->s1 + dep, ctx->c))
+BENCH_LOOP(strrchr, f(ctx->s1 + dep, ctx->c))
+BENCH_LOOP(memset, f(ctx->s1 + dep, ctx->c, ctx->n))
+BENCH_LOOP(memcpy, f(ctx->s1 + dep, ctx->s2, ctx->n))
+BENCH_LOOP(strcmp, f(ctx->s1 + dep, ctx->s2))
+BENCH_LOOP(memmove, f(ctx->s1 + dep, ctx->s2, ctx->n))
+BENCH_LOOP(strncmp, f(ctx->s1 + dep, ctx->s2, ctx->n))
+BENCH_LOOP(strcasecmp, f(ctx->s1 + dep, ctx->s2))
+BENCH_LOOP(strstr, f(ctx->s1 + dep, ctx->s2))
+BENCH_LOOP(strpbrk, f(ctx->s1 + dep, ctx->s2))
+BENCH_LOOP(strcspn, f(ctx->s1 + dep, ctx->s2))
+BENCH_LOOP(ffs, f(ctx->c + dep))
+BENCH_LOOP(memfrob, f(ctx->s1 + dep, ctx->n))
+BENCH_LOOP(strfry, f(ctx->s1 + dep))
+
+// Empty functions with the signature of each my_* pointer, to time the call alone
+static size_t bench_noop_strlen(char const *s)
+{
+    (void)s;
+    return 0;
+}
+
+static char *bench_noop_strchr(char const *s, int c)
+{
+    (void)s;
+    (void)c;
+    return NULL;
+}
+
+static char *bench_noop_strrchr(char const *s, int c)
+{
+    (void)s;
+    (void)c;
+    return NULL;
+}
+
+static void *bench_noop_memset(void *d, int c, size_t n)
+{
+    (void)c;
+    (void)n;
+    return d;
+}
+
+static size_t bench_noop_memcpy(void *d, const void *s, size_t n)
+{
+    (void)d;
+    (void)s;
+    (void)n;
+    return 0;
+}
+
+static int bench_noop_strcmp(const char *a, const char *b)
+{
+    (void)a;
+    (void)b;
+    return 0;
+}
+
+static void *bench_noop_memmove(void *d, const void *s, size_t n)
+{
+    (void)s;
+    (void)n;
+    return d;
+}
+
+static int bench_noop_strncmp(const char *a, const char *b, size_t n)
+{
+    (void)a;
+    (void)b;
+    (void)n;
+    return 0;
+}
+
+static int bench_noop_strcasecmp(const char *a, const char *b)
+{
+    (void)a;
+    (void)b;
+    return 0;
+}
+
+static char *bench_noop_strstr(const char *h, const char *n)
+{
+    (void)h;
+    (void)n;
+    return NULL;
+}
+
+static char *bench_noop_strpbrk(char const *s, char const *a)
+{
+    (void)s;
+    (void)a;
+    return NULL;
+}
+
+static size_t bench_noop_strcspn(char const *s, char const *a)
+{
+    (void)s;
+    (void)a;
+    return 0;
+}
+
+static int bench_noop_ffs(int i)
+{
+    (void)i;
+    return 0;
+}
+
+static char *bench_noop_memfrob(char *s, size_t n)
+{
+    (void)n;
+    return s;
+}
+
+static char *bench_noop_strfry(char *s)
+{
+    return s;
+}
+
+#define BENCH(name, prepare, sized) \
+    {#name, (void **)&my_##name, (void *)name, prepare, bench_loop_##name, \
+     bench_chain_##name, (void *)bench_noop_##name, sized}
+
+static const struct bench BENCHS[] = {
+    BENCH(strlen, prepare_string, 1),
+    BENCH(strchr, prepare_string, 1),
+    BENCH(strrchr, prepare_string, 1),
+    BENCH(memset, prepare_buffers, 1),
+    BENCH(memcpy, prepare_buffers, 1),
+    BENCH(strcmp, prepare_strings, 1),
+    BENCH(memmove, prepare_buffers, 1),
+    BENCH(strncmp, prepare_strings, 1),
+    BENCH(strcasecmp, prepare_strcasecmp, 1),
+    BENCH(strstr, prepare_accept, 1),
+    BENCH(strpbrk, prepare_accept, 1),
+    BENCH(strcspn, prepare_accept, 1),
+    BENCH(ffs, prepare_ffs, 0),
+    BENCH(memfrob, prepare_buffers, 1),
+    BENCH(strfry, prepare_string, 1),
+};
+
+#define NB_BENCHS (sizeof(BENCHS) / sizeof(BENCHS[0]))
+
+/*
+
+Cache states
+hot: the same buffers for every call, as above
+cold: the buffers are flushed with clflush before each call, and only the call is timed with the TSC
+stream: each call takes the next of many copies of the buffers, spread over four times the last level cache
+
+*/
+
+enum {
+    CACHE_HOT,
+    CACHE_COLD,
+    CACHE_STREAM,
+    NB_CACHE_MODES,
+};
+
+static const char *CACHE_MODES[] = {"hot", "cold", "stream"};
+
+int cache_modes = 1 << CACHE_HOT;
+char *cache_region = NULL;
+size_t cache_region_size = 0;
+
+struct cache_arg {
+    const struct bench *b;
+    struct bench_ctx *ctx;
+    size_t size;
+    size_t slot;
+    size_t nb_slots;
+    size_t next;
+};
+
+// "hot,cold,stream" or a part of it
+void parse_cache_modes(char *arg)
+{
+    cache_modes = 0;
+    for (char *item = strtok(arg, ","); item != NULL; item = strtok(NULL, ",")) {
+        int mode = NB_CACHE_MODES;
+        for (int i = 0; i < NB_CACHE_MODES; i++) {
+            if (strcmp(item, CACHE_MODES[i]) == 0) {
+                mode = i;
+            }
+        }
+        if (mode == NB_CACHE_MODES) {
+            printf("Unknown cache mode: [%s]!\n", item);
+            exit(1);
+        }
+        cache_modes |= 1 << mode;
+    }
+}
+
+static void cache_flush(const char *p, size_t size)
+{
+    for (size_t i = 0; i < size; i += 64) {
+        _mm_clflush(p + i);
+    }
+}
+
+// TSC ticks per nanosecond, measured once over 20 ms
+static double cache_tsc_per_ns(void)
+{
+    static double ratio = 0;
+
+    if (ratio == 0) {
+        uint64_t t = measure_now_ns();
+        uint64_t c = __rdtsc();
+        while (measure_now_ns() - t < 20 * 1000 * 1000) {
+        }
+        ratio = (double)(__rdtsc() - c) / (measure_now_ns() - t);
+    }
+    return ratio;
+}
+
+// TSC ticks of one call right after its buffers were flushed
+static uint64_t cache_cold_call(const struct bench *b, void *fn, struct bench_ctx *ctx, size_t size)
+{
+    unsigned int aux;
+
+    cache_flush(ctx->s1, size + 64);
+    cache_flush(ctx->s2, size + 64);
+    _mm_mfence();
+    _mm_lfence();
+    uint64_t start = __rdtsc();
+    _mm_lfence();
+    b->loop(fn, ctx, 1);
+    uint64_t end = __rdtscp(&aux);
+    _mm_lfence();
+    return end - start;
+}
+
+// Only the calls are timed, the flushes are left out
+static void cache_measure_cold(const struct bench *b, void *fn, struct bench_ctx *ctx, size_t size,
+                               struct measurement *m)
+{
+    double ns[MEASURE_MAX_SAMPLES];
+    double cycles[MEASURE_MAX_SAMPLES];
+    uint64_t sample_ns = measure_target_ns / measure_samples;
+    uint64_t overhead = UINT64_MAX;
+    size_t calls = 0;
+
+    for (int i = 0; i < 1000; i++) {
+        uint64_t t = cache_cold_call(b, b->noop, ctx, 0);
+        overhead = t < overhead ? t : overhead;
+    }
+    for (int i = 0; i < measure_samples; i++) {
+        uint64_t busy = 0;
+        calls = 0;
+        for (uint64_t t = measure_now_ns(); calls == 0 || measure_now_ns() - t < sample_ns; calls++) {
+            uint64_t ticks = cache_cold_call(b, fn, ctx, size);
+            busy += ticks > overhead ? ticks - overhead : 0;
+        }
+        cycles[i] = (double)busy / calls;
+        ns[i] = cycles[i] / cache_tsc_per_ns();
+    }
+    measure_summary(ns, cycles, measure_samples, calls, m);
+}
+
+static void cache_loop_stream(void *fn, void *arg, size_t iters)
+{
+    struct cache_arg *a = arg;
+    struct bench_ctx ctx = *a->ctx;
+
+    for (size_t i = 0; i < iters; i++) {
+        ctx.s1 = cache_region + a->next * a->slot;
+        ctx.s2 = ctx.s1 + a->slot / 2;
+        a->b->loop(fn, &ctx, 1);
+        a->next = a->next + 1 == a->nb_slots ? 0 : a->next + 1;
+    }
+}
+
+// Copies of the prepared buffers in every slot of the region
+static void cache_prepare_stream(struct cache_arg *a)
+{
+    a->slot = ((a->size + 64 + 63) / 64 * 64) * 2;
+    a->nb_slots = cache_region_size / a->slot;
+    a->next = 0;
+    for (size_t i = 1; i < a->nb_slots; i++) {
+        memcpy(cache_region + i * a->slot, cache_region, a->slot);
+    }
+}
+
+// The stream region is filled once per size and shared by the library and glibc:
+// copying four times the last level cache before every measurement would dominate the run
+struct bench_ctx cache_stream_ctx;
+struct cache_arg cache_stream = {NULL, &cache_stream_ctx, 0, 0, 0, 0};
+
+void cache_prepare(int mode, const struct bench *b, const struct bench_ctx *ctx, size_t size)
+{
+    if (mode != CACHE_STREAM) {
+        return;
+    }
+    cache_stream_ctx = *ctx;
+    cache_stream_ctx.s1 = cache_region;
+    cache_stream_ctx.s2 = cache_region + ((size + 64 + 63) / 64 * 64);
+    b->prepare(&cache_stream_ctx, size);
+    cache_stream.b = b;
+    cache_stream.size = size;
+    cache_prepare_stream(&cache_stream);
+}
+
+// The stream mode needs a cache_prepare of the same bench and size first
+void cache_measure(int mode, const struct bench *b, void *fn, struct bench_ctx *ctx, size_t size,
+                   struct measurement *m)
+{
+    if (mode == CACHE_HOT) {
+        b->prepare(ctx, size);
+        measure(b->loop, fn, ctx, m);
+    } else if (mode == CACHE_COLD) {
+        b->prepare(ctx, size);
+        cache_measure_cold(b, fn, ctx, size, m);
+    } else {
+        assert(cache_stream.b == b && cache_stream.size == size);
+        cache_stream.next = 0;
+        measure(cache_loop_stream, fn, &cache_stream, m);
+    }
+}
+
+void cache_setup(void)
+{
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+
+    if (!(cache_modes & (1 << CACHE_STREAM))) {
+        return;
+    }
+    cache_region_size = llc > 0 ? 4 * llc : 256 << 20;
+    if (cache_region_size < 4 * (bench_max + 128)) {
+        cache_region_size = (4 * (bench_max + 128) + 63) / 64 * 64;
+    }
+    NOT_NULL(cache_region = aligned_alloc(64, cache_region_size));
+    printf("--> Streaming over %lu MB, %ld KB of last level cache\n", cache_region_size >> 20,
+           llc / 1024);
+}
+
+static void print_measurement(const struct measurement *m)
+{
+    printf("%10.2f \xC2\xB1%-7.2f%s", m->median, (m->hi - m->lo) / 2,
+           m->noisy ? "\x1B[33m~\e[0m" : " ");
+}
+
+// Green or red only when the confidence intervals do not overlap
+static void print_bench_row(size_t size, struct measurement *mine,
+    struct measurement *libc)
+{
+    char *colors[] = {"\x1B[32m", "", "\x1B[31m"};
+    double speedup = libc->median / mine->median;
+
+    printf("%10lu | ", size);
+    print_measurement(mine);
+    printf(" | ");
+    print_measurement(libc);
+    printf(" | %8.3f | %8.3f | %s%6.2fx\e[0m\n",
+           size / mine->cycles, size / libc->cycles,
+           colors[measure_compare(mine, libc) + 1], speedup);
+}
+
+// --lib with several libraries: speedups over glibc of every library, ranked per size bucket
+struct rank_entry {
+    const char *funcname;
+    size_t size;
+    int library;
+    double speedup;
+};
+
+static const struct {
+    size_t max;
+    char *label;
+} RANK_BUCKETS[] = {
+    {16, "<= 16 B"},
+    {256, "<= 256 B"},
+    {4096, "<= 4 KB"},
+    {65536, "<= 64 KB"},
+    {1 << 20, "<= 1 MB"},
+    {SIZE_MAX, "> 1 MB"},
+};
+
+struct rank_entry *rank_entries = NULL;
+size_t nb_rank_entries = 0;
+
+void rank_record(const char *funcname, size_t size, const struct measurement *mine,
+                 const struct measurement *libc)
+{
+    if (nb_libraries < 2) {
+        return;
+    }
+    if ((nb_rank_entries & (nb_rank_entries - 1)) == 0) {
+        size_t capacity = nb_rank_entries ? nb_rank_entries * 2 : 64;
+        NOT_NULL(rank_entries = realloc(rank_entries, capacity * sizeof(*rank_entries)));
+    }
+    rank_entries[nb_rank_entries++] = (struct rank_entry){
+        funcname, size, current_library, libc->median / mine->median
+    };
+}
+
+// Geometric mean of the speedups of a library in a bucket, 0 if it has none
+static double rank_score(const char *funcname, int library, size_t min, size_t max)
+{
+    double sum = 0;
+    int count = 0;
+
+    for (size_t i = 0; i < nb_rank_entries; i++) {
+        const struct rank_entry *e = &rank_entries[i];
+        if (e->library == library && e->size >= min && e->size <= max
+            && strcmp(e->funcname, funcname) == 0) {
+            sum += log(e->speedup);
+            count++;
+        }
+    }
+    return count ? exp(sum / count) : 0;
+}
+
+void print_rankings(void)
+{
+    if (nb_rank_entries > 0) {
+        printf("\n");
+    }
+    for (size_t i = 0; i < nb_rank_entries; i++) {
+        const char *funcname = rank_entries[i].funcname;
+        size_t j = 0;
+        while (strcmp(rank_entries[j].funcname, funcname) != 0) {
+            j++;
+        }
+        if (j != i) {
+            continue;
+        }
+        printf("|------------| Ranking for: [%s] |------------|\n\n", funcname);
+        int index = symbol_index(funcname);
+        size_t min = 0;
+        for (unsigned int b = 0; b < sizeof(RANK_BUCKETS) / sizeof(RANK_BUCKETS[0]); b++) {
+            int order[MAX_LIBRARIES];
+            double scores[MAX_LIBRARIES];
+            int n = 0;
+            for (int lib = 0; lib < nb_libraries; lib++) {
+                double score = rank_score(funcname, lib, min, RANK_BUCKETS[b].max);
+                if (score == 0) {
+                    continue;
+                }
+                int k = n++;
+                for (; k > 0 && scores[k - 1] < score; k--) {
+                    scores[k] = scores[k - 1];
+                    order[k] = order[k - 1];
+                }
+                scores[k] = score;
+                order[k] = lib;
+            }
+            min = RANK_BUCKETS[b].max + 1;
+            if (n == 0) {
+                continue;
+            }
+            printf("\t%-10s", RANK_BUCKETS[b].label);
+            for (int k = 0; k < n; k++) {
+                printf("  %d. [%s] %sx%.2f\e[0m", k + 1, libraries[order[k]].path,
+                       scores[k] >= 1 ? "\x1B[32m" : "\x1B[31m", scores[k]);
+                if (index >= 0 && libraries[order[k]].failures[index] > 0) {
+                    printf(" \x1B[31m(%d failed tests)\e[0m", libraries[order[k]].failures[index]);
+                }
+            }
+            printf("\n");
+        }
+        printf("\n");
+    }
+    free(rank_entries);
+    rank_entries = NULL;
+    nb_rank_entries = 0;
+}
+
+// The results also depend on the machine, glibc and the measurement settings
+static uint64_t result_bench_key(const struct bench *b)
+{
+    struct {
+        unsigned int cpu[12];
+        char libc[32];
+        uint64_t target_ns;
+        uint64_t warmup_ns;
+        int samples;
+        int cpu_index;
+        double noise;
+    } settings;
+
+    memset(&settings, 0, sizeof(settings));
+    for (unsigned int i = 0; i < 3; i++) {
+        unsigned int *r = &settings.cpu[4 * i];
+        __get_cpuid(0x80000002 + i, &r[0], &r[1], &r[2], &r[3]);
+    }
+    snprintf(settings.libc, sizeof(settings.libc), "%s", gnu_get_libc_version());
+    settings.target_ns = measure_target_ns;
+    settings.warmup_ns = measure_warmup_ns;
+    settings.samples = measure_samples;
+    settings.cpu_index = measure_cpu;
+    settings.noise = measure_noise;
+    return result_key(b->funcname, &settings, sizeof(settings));
+}
+
+static void result_pack(double *values, const struct measurement *m)
+{
+    values[0] = m->median;
+    values[1] = m->lo;
+    values[2] = m->hi;
+    values[3] = m->cycles;
+    values[4] = m->iters;
+    values[5] = m->kept;
+    values[6] = m->noisy;
+}
+
+static void result_unpack(const double *values, struct measurement *m)
+{
+    m->median = values[0];
+    m->lo = values[1];
+    m->hi = values[2];
+    m->cycles = values[3];
+    m->iters = values[4];
+    m->kept = values[5];
+    m->noisy = values[6];
+}
+
+static void run_bench_sizes(const struct bench *b, int mode)
+{
+    struct bench_ctx ctx = {bench_buf1, bench_buf2, 0, 0, 0};
+    // The counters of --perf need live measurements
+    uint64_t key = perf_mode ? 0 : result_bench_key(b);
+    struct measurement mine;
+    struct measurement libc;
+    int cached = 0;
+
+    if (cache_modes != 1 << CACHE_HOT) {
+        printf("\t-- %s cache --\n", CACHE_MODES[mode]);
+    }
+    printf("%10s | %-20s | %-20s | %8s | %8s | %s\n", "size",
+           "ns/call", "glibc ns/call", "B/cyc", "glibc", "speedup");
+    for (size_t size = 0; size <= bench_max; size = size ? size * 2 : 1) {
+        const struct result_entry *e = result_find('B', key, b->funcname, size, mode);
+        if (e != NULL) {
+            result_unpack(e->values, &mine);
+            result_unpack(e->values + 7, &libc);
+            result_hits++;
+            cached++;
+        } else {
+            struct result_entry r = {'B', key, "", size, mode, {0}};
+            cache_prepare(mode, b, &ctx, size);
+            cache_measure(mode, b, *b->sym, &ctx, size, &mine);
+            cache_measure(mode, b, b->libc, &ctx, size, &libc);
+            snprintf(r.funcname, sizeof(r.funcname), "%s", b->funcname);
+            result_pack(r.values, &mine);
+            result_pack(r.values + 7, &libc);
+            result_store(&r);
+        }
+        print_bench_row(size, &mine, &libc);
+        if (mode == CACHE_HOT) {
+            rank_record(b->funcname, size, &mine, &libc);
+            if (current_library == 0) {
+                baseline_check(b->funcname, size, &mine, &libc);
+            }
+        }
+        if (perf_mode && mode == CACHE_HOT) {
+            struct perf_counts mine_counts;
+            struct perf_counts libc_counts;
+            perf_count(&perf, b->loop, *b->sym, &ctx, mine.iters, &mine_counts);
+            perf_count(&perf, b->loop, b->libc, &ctx, libc.iters, &libc_counts);
+            print_perf_row(size, &mine_counts, &libc_counts);
+        }
+        if (!b->sized) {
+            break;
+        }
+    }
+    if (cached > 0) {
+        printf("\t(%d size%s from the result cache)\n", cached, cached > 1 ? "s" : "");
+    }
+}
+
+void run_bench(const struct bench *b)
+{
+    printf("|------------| Running benchmark for: [%s] |------------|\n\n",
+           b->funcname);
+    if (*b->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    for (int mode = 0; mode < NB_CACHE_MODES; mode++) {
+        if (cache_modes & (1 << mode)) {
+            run_bench_sizes(b, mode);
+            puts("");
+        }
+    }
+}
+
+void run_benchmarks(int ac, char **av)
+{
+    measure_pin();
+    printf("--> Measuring with %d samples over %lu ms, noise threshold %.1f%%\n",
+           measure_samples, measure_target_ns / 1000000, measure_noise * 100);
+    printf("--> Times are medians \xC2\xB1 half the 95%% confidence interval, "
+           "\x1B[33m~\e[0m marks a result too noisy to trust\n\n");
+    if (perf_mode && !perf_open(&perf)) {
+        printf("\x1B[33m--> Hardware counters unavailable, timing only\n\e[0m");
+        perf_mode = 0;
+    }
+    if (perf_mode) {
+        printf("--> Counters per call: IPC, branch misses, L1D and LLC misses per byte\n");
+    }
+    if (baseline_path != NULL && current_library == 0) {
+        baseline_load(baseline_path);
+    }
+    NOT_NULL(bench_buf1 = aligned_alloc(64, bench_max + 64));
+    NOT_NULL(bench_buf2 = aligned_alloc(64, bench_max + 64));
+    cache_setup();
+    for (unsigned int i = 0; i < NB_BENCHS; i++) {
+        if (is_selected(BENCHS[i].funcname, ac, av)) {
+            run_bench(&BENCHS[i]);
+        }
+    }
+    free(bench_buf1);
+    free(bench_buf2);
+    free(cache_region);
+    cache_region = NULL;
+    if (perf_mode) {
+        perf_close(&perf);
+    }
+}
+
+/*
+
+Crossovers
+Sizes where the time per call jumps, that is where an implementation switches
+strategy, found by bisecting a sweep of four sizes per octave (--crossover)
+
+*/
+
+#define CROSSOVER_PER_OCTAVE 4
+#define CROSSOVER_RESOLUTION 64
+#define CROSSOVER_MAX_POINTS 1024
+
+int crossover_mode = 0;
+size_t crossover_max = 1 << 20;
+double crossover_jump = 0.2;
+
+struct crossover_point {
+    size_t size;
+    struct measurement mine;
+    struct measurement libc;
+};
+
+struct crossover_step {
+    size_t before;
+    size_t after;
+    double ratio;       // time per byte after the step over time per byte before
+};
+
+static void crossover_measure(const struct bench *b, struct bench_ctx *ctx,
+                              struct crossover_point *p, size_t size)
+{
+    p->size = size;
+    cache_measure(CACHE_HOT, b, *b->sym, ctx, size, &p->mine);
+    cache_measure(CACHE_HOT, b, b->libc, ctx, size, &p->libc);
+}
+
+// 1 if the time per call drops by more than --crossover-jump, a faster strategy,
+// -1 if it grows faster than the size by more than that, a cliff, 0 otherwise.
+// Both ends of the confidence intervals must agree
+static int crossover_direction(size_t s1, const struct measurement *m1, size_t s2,
+                               const struct measurement *m2)
+{
+    if (m1->lo > m2->hi * (1 + crossover_jump)) {
+        return 1;
+    }
+    if (m2->lo * s1 > m1->hi * s2 * (1 + crossover_jump)) {
+        return -1;
+    }
+    return 0;
+}
+
+static int crossover_at(const struct crossover_point *a, const struct crossover_point *b, int libc)
+{
+    if (libc) {
+        return crossover_direction(a->size, &a->libc, b->size, &b->libc);
+    }
+    return crossover_direction(a->size, &a->mine, b->size, &b->mine);
+}
+
+// Bisect every pair of neighbours with a step until they are close enough
+static int crossover_refine(const struct bench *b, struct bench_ctx *ctx,
+                            struct crossover_point *points, int nb)
+{
+    int i = 0;
+
+    while (i + 1 < nb && nb < CROSSOVER_MAX_POINTS) {
+        struct crossover_point *p = &points[i];
+        size_t width = p[1].size - p->size;
+        if (width <= 1 || width <= p->size / CROSSOVER_RESOLUTION
+            || (!crossover_at(p, p + 1, 0) && !crossover_at(p, p + 1, 1))) {
+            i++;
+            continue;
+        }
+        memmove(p + 2, p + 1, (nb - i - 1) * sizeof(*p));
+        crossover_measure(b, ctx, p + 1, p->size + width / 2);
+        nb++;
+    }
+    return nb;
+}
+
+static int crossover_steps(const struct crossover_point *points, int nb, int libc,
+                           struct crossover_step *steps)
+{
+    int n = 0;
+
+    for (int i = 0; i + 1 < nb; i++) {
+        const struct crossover_point *a = &points[i];
+        const struct crossover_point *b = &points[i + 1];
+        if (crossover_at(a, b, libc) != 0) {
+            const struct measurement *ma = libc ? &a->libc : &a->mine;
+            const struct measurement *mb = libc ? &b->libc : &b->mine;
+            steps[n++] = (struct crossover_step){
+                a->size, b->size, (mb->median / b->size) / (ma->median / a->size)
+            };
+        }
+    }
+    return n;
+}
+
+// A step of the other implementation in the same direction, at most twice as far
+static const struct crossover_step *crossover_match(const struct crossover_step *step,
+                                                    const struct crossover_step *others, int nb)
+{
+    const struct crossover_step *best = NULL;
+
+    for (int i = 0; i < nb; i++) {
+        const struct crossover_step *o = &others[i];
+        if ((o->ratio > 1) != (step->ratio > 1) || o->after > 2 * step->after
+            || 2 * o->after < step->after) {
+            continue;
+        }
+        if (best == NULL || labs((long)o->after - (long)step->after)
+                            < labs((long)best->after - (long)step->after)) {
+            best = o;
+        }
+    }
+    return best;
+}
+
+static int print_crossover_steps(const char *impl, const char *impl_other,
+                                 const struct crossover_step *steps, int nb,
+                                 const struct crossover_step *others, int nb_others)
+{
+    int unmatched = 0;
+
+    printf("\tSteps of %s:%s\n", impl, nb ? "" : " [none]");
+    for (int i = 0; i < nb; i++) {
+        const struct crossover_step *s = &steps[i];
+        const struct crossover_step *o = crossover_match(s, others, nb_others);
+        printf("\t%10lu -> %-10lu %s%-9s x%.2f\e[0m", s->before, s->after,
+               s->ratio > 1 ? "\x1B[31m" : "\x1B[32m", s->ratio > 1 ? "cliff" : "faster",
+               1 / s->ratio);
+        if (o == NULL) {
+            printf("   \x1B[33mnot on the other side\e[0m\n");
+        } else {
+            printf("   %s at %lu -> %lu: x%.2f\n", impl_other, o->before, o->after, 1 / o->ratio);
+        }
+        // A cliff counts against the library when glibc has none or a much smaller one
+        unmatched += s->ratio > 1 && (o == NULL || s->ratio > o->ratio * (1 + crossover_jump));
+    }
+    return unmatched;
+}
+
+// Runs of points where the library is significantly slower than glibc by more than the jump
+static void print_crossover_losses(const struct crossover_point *points, int nb)
+{
+    int found = 0;
+
+    printf("\tLosses against glibc:");
+    for (int i = 0; i < nb;) {
+        int j = i;
+        int worst = i;
+        double sum = 0;
+        for (; j < nb; j++) {
+            const struct crossover_point *p = &points[j];
+            double speedup = p->libc.median / p->mine.median;
+            if (measure_compare(&p->mine, &p->libc) != 1 || speedup * (1 + crossover_jump) > 1) {
+                break;
+            }
+            sum += log(speedup);
+            if (speedup < points[worst].libc.median / points[worst].mine.median) {
+                worst = j;
+            }
+        }
+        if (j == i) {
+            i++;
+            continue;
+        }
+        printf("\n\t%10lu .. %-10lu \x1B[31mx%.2f\e[0m on average, x%.2f at %lu",
+               points[i].size, points[j - 1].size, exp(sum / (j - i)),
+               points[worst].libc.median / points[worst].mine.median, points[worst].size);
+        found = 1;
+        i = j;
+    }
+    printf("%s\n\n", found ? "" : " [none]");
+}
+
+void run_crossover(const struct bench *b, struct bench_ctx *ctx)
+{
+    static struct crossover_point points[CROSSOVER_MAX_POINTS];
+    static struct crossover_step mine[CROSSOVER_MAX_POINTS];
+    static struct crossover_step libc[CROSSOVER_MAX_POINTS];
+    int nb = 0;
+
+    printf("|------------| Running crossovers for: [%s] |------------|\n\n", b->funcname);
+    if (*b->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    for (int k = 0;; k++) {
+        size_t size = (size_t)round(exp2((double)k / CROSSOVER_PER_OCTAVE));
+        if (size > crossover_max) {
+            break;
+        }
+        if (nb == 0 || size != points[nb - 1].size) {
+            crossover_measure(b, ctx, &points[nb++], size);
+        }
+    }
+    int coarse = nb;
+    nb = crossover_refine(b, ctx, points, nb);
+    printf("\tSizes:       [%d, %d added around the steps]\n", nb, nb - coarse);
+    int nb_mine = crossover_steps(points, nb, 0, mine);
+    int nb_libc = crossover_steps(points, nb, 1, libc);
+    int unmatched = print_crossover_steps("the library", "glibc", mine, nb_mine, libc, nb_libc);
+    print_crossover_steps("glibc", "library", libc, nb_libc, mine, nb_mine);
+    print_crossover_losses(points, nb);
+    if (unmatched) {
+        printf("\x1B[31m\t%d cliff%s deeper than in glibc\n\n\e[0m", unmatched,
+               unmatched > 1 ? "s" : "");
+        failure++;
+    } else {
+        success++;
+    }
+}
+
+void run_crossovers(int ac, char **av)
+{
+    struct bench_ctx ctx = {0};
+
+    measure_pin();
+    printf("--> Steps of more than %.0f%% in the time per byte, located to 1/%d of the size\n\n",
+           crossover_jump * 100, CROSSOVER_RESOLUTION);
+    NOT_NULL(ctx.s1 = aligned_alloc(64, crossover_max + 64));
+    NOT_NULL(ctx.s2 = aligned_alloc(64, crossover_max + 64));
+    for (unsigned int i = 0; i < NB_BENCHS; i++) {
+        if (BENCHS[i].sized && is_selected(BENCHS[i].funcname, ac, av)) {
+            run_crossover(&BENCHS[i], &ctx);
+        }
+    }
+    free(ctx.s1);
+    free(ctx.s2);
+}
+
+/*
+
+Latency
+Per-call timings of small calls in a log-linear histogram, next to the
+time per call of a dependent chain and of independent calls
+
+*/
+
+#define HIST_SUB_BITS 7
+#define HIST_HALF (1 << (HIST_SUB_BITS - 1))
+#define HIST_BUCKETS ((1 << HIST_SUB_BITS) + 58 * HIST_HALF)
+
+int latency_mode = 0;
+size_t latency_max = 64;
+size_t latency_samples = 100000;
+
+// Exact up to 127 cycles, then 64 buckets per power of two (under 1.6% error)
+struct histogram {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+};
+
+static int hist_index(uint64_t v)
+{
+    if (v < (1 << HIST_SUB_BITS)) {
+        return v;
+    }
+    int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS + 1;
+    return (1 << HIST_SUB_BITS) + (shift - 1) * HIST_HALF + (v >> shift) - HIST_HALF;
+}
+
+static uint64_t hist_value(int index)
+{
+    if (index < (1 << HIST_SUB_BITS)) {
+        return index;
+    }
+    int shift = (index - (1 << HIST_SUB_BITS)) / HIST_HALF + 1;
+    uint64_t sub = (index - (1 << HIST_SUB_BITS)) % HIST_HALF + HIST_HALF;
+    return sub << shift;
+}
+
+void hist_add(struct histogram *h, uint64_t v)
+{
+    h->counts[hist_index(v)]++;
+    h->total++;
+    h->max = v > h->max ? v : h->max;
+}
+
+uint64_t hist_percentile(const struct histogram *h, double q)
+{
+    uint64_t rank = (uint64_t)(q * h->total);
+    uint64_t seen = 0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen > rank) {
+            return hist_value(i);
+        }
+    }
+    return h->max;
+}
+
+static size_t latency_noop(void)
+{
+    return 0;
+}
+
+// lfence keeps the call from being reordered around the timestamps
+static void latency_record(const struct bench *b, void *fn, struct bench_ctx *ctx,
+    struct histogram *h, uint64_t overhead)
+{
+    unsigned int aux;
+
+    memset(h, 0, sizeof(*h));
+    for (size_t i = 0; i < latency_samples; i++) {
+        _mm_lfence();
+        uint64_t start = __rdtsc();
+        _mm_lfence();
+        b->loop(fn, ctx, 1);
+        uint64_t cycles = __rdtscp(&aux) - start;
+        _mm_lfence();
+        hist_add(h, cycles > overhead ? cycles - overhead : 0);
+    }
+}
+
+static void print_latency_row(char *impl, const struct histogram *h,
+    const struct measurement *chain, const struct measurement *thru)
+{
+    printf(" %-5s | %7lu | %7lu | %7lu | %7lu | %10.2f | %10.2f\n", impl,
+           hist_percentile(h, 0.5), hist_percentile(h, 0.99),
+           hist_percentile(h, 0.999), h->max, chain->median, thru->median);
+}
+
+void run_latency(const struct bench *b, uint64_t overhead)
+{
+    static const size_t sizes[] = {1, 2, 3, 4, 7, 8, 15, 16, 31, 32, 63, 64, 127, 128,
+        255, 256, 511, 512, 1023, 1024};
+    struct bench_ctx ctx = {bench_buf1, bench_buf2, 0, 0, 0};
+    struct histogram *h;
+    struct measurement chain;
+    struct measurement thru;
+    void *impls[] = {*b->sym, b->libc};
+    char *names[] = {"mine", "glibc"};
+
+    printf("|------------| Running latency for: [%s] |------------|\n\n", b->funcname);
+    if (*b->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    NOT_NULL(h = malloc(sizeof(*h)));
+    printf("%10s | %-5s | %7s | %7s | %7s | %7s | %10s | %10s\n", "size", "impl",
+           "p50", "p99", "p99.9", "max", "chain ns", "thru ns");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes) && sizes[i] <= latency_max; i++) {
+        for (int impl = 0; impl < 2; impl++) {
+            b->prepare(&ctx, sizes[i]);
+            latency_record(b, impls[impl], &ctx, h, overhead);
+            measure(b->chain, impls[impl], &ctx, &chain);
+            measure(b->loop, impls[impl], &ctx, &thru);
+            if (impl == 0) {
+                printf("%10lu |", sizes[i]);
+            } else {
+                printf("%10s |", "");
+            }
+            print_latency_row(names[impl], h, &chain, &thru);
+        }
+        if (!b->sized) {
+            break;
+        }
+    }
+    puts("");
+    free(h);
+}
+
+void run_latencies(int ac, char **av)
+{
+    struct bench_ctx ctx = {0};
+    struct histogram *h;
+    uint64_t overhead;
+
+    measure_pin();
+    NOT_NULL(h = calloc(1, sizeof(*h)));
+    latency_record(&BENCHS[0], (void *)latency_noop, &ctx, h, 0);
+    overhead = hist_percentile(h, 0);
+    free(h);
+    printf("--> Percentiles in TSC cycles over %lu calls, minus the %lu cycles of an empty call\n",
+           latency_samples, overhead);
+    printf("--> chain: each call waits for the previous result, thru: independent calls\n\n");
+    NOT_NULL(bench_buf1 = aligned_alloc(64, latency_max + 64));
+    NOT_NULL(bench_buf2 = aligned_alloc(64, latency_max + 64));
+    for (unsigned int i = 0; i < NB_BENCHS; i++) {
+        if (is_selected(BENCHS[i].funcname, ac, av)) {
+            run_latency(&BENCHS[i], overhead);
+        }
+    }
+    free(bench_buf1);
+    free(bench_buf2);
+}
+
+/*
+
+Complexity
+strstr, strpbrk and strcspn on pathological inputs of growing size, with
+the exponent of the time against the size fitted on the largest points
+
+*/
+
+#define COMPLEXITY_POINTS 32
+#define COMPLEXITY_FIT 5
+
+int complexity_mode = 0;
+size_t complexity_max = 1 << 20;
+uint64_t complexity_cap_ns = 50 * 1000 * 1000;
+double complexity_limit = 1.3;
+
+struct complexity {
+    char *funcname;
+    char *scenario;
+    void (*prepare)(struct bench_ctx *, size_t, size_t);
+    // Either n grows with m fixed (n / 4 when 0), or n is fixed and m grows up to m
+    int grow_m;
+    size_t m;
+};
+
+struct complexity_point {
+    size_t n;
+    size_t m;
+    double mine;
+    double libc;
+};
+
+static void repeat(char *s, const char *pattern, size_t len)
+{
+    size_t plen = strlen(pattern);
+
+    for (size_t i = 0; i < len; i++) {
+        s[i] = pattern[i % plen];
+    }
+    s[len] = '\0';
+}
+
+static void prepare_needle_ab(struct bench_ctx *ctx, size_t n, size_t m)
+{
+    repeat(ctx->s1, "a", n);
+    repeat(ctx->s2, "a", m);
+    ctx->s2[m - 1] = 'b';
+}
+
+static void prepare_needle_ba(struct bench_ctx *ctx, size_t n, size_t m)
+{
+    repeat(ctx->s1, "a", n);
+    repeat(ctx->s2, "a", m);
+    ctx->s2[0] = 'b';
+}
+
+static void prepare_needle_periodic(struct bench_ctx *ctx, size_t n, size_t m)
+{
+    repeat(ctx->s1, "aab", n);
+    repeat(ctx->s2, "aab", m);
+    ctx->s2[m - 1] = ctx->s2[m - 1] == 'b' ? 'a' : 'b';
+}
+
+// m distinct bytes, none of them in the haystack
+static void prepare_large_set(struct bench_ctx *ctx, size_t n, size_t m)
+{
+    repeat(ctx->s1, "\x01", n);
+    for (size_t i = 0; i < m; i++) {
+        ctx->s2[i] = (char)(255 - i);
+    }
+    ctx->s2[m] = '\0';
+}
+
+static const struct complexity COMPLEXITIES[] = {
+    {"strstr", "haystack a...a, needle a...ab", prepare_needle_ab, 0, 0},
+    {"strstr", "haystack a...a, needle a...ab, fixed haystack", prepare_needle_ab, 1, 1 << 16},
+    {"strstr", "haystack a...a, needle ba...a", prepare_needle_ba, 0, 0},
+    {"strstr", "periodic haystack aabaab..., needle aab...aab with its last byte changed",
+     prepare_needle_periodic, 0, 0},
+    {"strpbrk", "254 bytes accept set, none in the haystack", prepare_large_set, 0, 254},
+    {"strpbrk", "growing accept set, none in the haystack", prepare_large_set, 1, 254},
+    {"strcspn", "254 bytes reject set, none in the haystack", prepare_large_set, 0, 254},
+    {"strcspn", "growing reject set, none in the haystack", prepare_large_set, 1, 254},
+};
+
+// Least squares slope of log(time) against log(size)
+static double fit_exponent(const struct complexity_point *points, int nb, int growing_m, int libc)
+{
+    double sx = 0;
+    double sy = 0;
+    double sxx = 0;
+    double sxy = 0;
+    int first = nb > COMPLEXITY_FIT ? nb - COMPLEXITY_FIT : 0;
+
+    for (int i = first; i < nb; i++) {
+        double x = log(growing_m ? points[i].m : points[i].n);
+        double y = log(libc ? points[i].libc : points[i].mine);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    nb -= first;
+    return (nb * sxy - sx * sy) / (nb * sxx - sx * sx);
+}
+
+// One call first: when it is already over the cap, it is the last point
+static double complexity_time(const struct bench *b, void *fn, struct bench_ctx *ctx, int *capped)
+{
+    struct measurement m;
+    uint64_t start = measure_now_ns();
+
+    b->loop(fn, ctx, 1);
+    uint64_t once = measure_now_ns() - start;
+    if (once > complexity_cap_ns) {
+        *capped = 1;
+        return once;
+    }
+    measure(b->loop, fn, ctx, &m);
+    return m.median;
+}
+
+static const struct bench *find_bench(const char *funcname)
+{
+    for (unsigned int i = 0; i < NB_BENCHS; i++) {
+        if (strcmp(BENCHS[i].funcname, funcname) == 0) {
+            return &BENCHS[i];
+        }
+    }
+    return NULL;
+}
+
+void run_complexity(const struct complexity *cx, struct bench_ctx *ctx)
+{
+    const struct bench *b = find_bench(cx->funcname);
+    struct complexity_point points[COMPLEXITY_POINTS];
+    int nb = 0;
+    int capped = 0;
+
+    printf("|------------| Running complexity for: [%s] |------------|\n", cx->funcname);
+    printf("\t%s\n\n", cx->scenario);
+    if (*b->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    printf("%10s | %10s | %14s | %14s\n", "n", "m", "ns/call", "glibc ns/call");
+    for (size_t size = cx->grow_m ? 1 : 256; !capped && nb < COMPLEXITY_POINTS; size *= 2) {
+        struct complexity_point *p = &points[nb];
+        p->n = cx->grow_m ? complexity_max / 4 : size;
+        if (cx->grow_m) {
+            p->m = size > cx->m ? cx->m : size;
+        } else {
+            p->m = cx->m ? cx->m : size / 4;
+        }
+        if (p->n > complexity_max || (cx->grow_m && nb > 0 && p->m == points[nb - 1].m)) {
+            break;
+        }
+        cx->prepare(ctx, p->n, p->m);
+        p->mine = complexity_time(b, *b->sym, ctx, &capped);
+        p->libc = complexity_time(b, b->libc, ctx, &capped);
+        printf("%10lu | %10lu | %14.1f | %14.1f\n", p->n, p->m, p->mine, p->libc);
+        nb++;
+    }
+    if (capped) {
+        printf("\t(stopped: a call took more than %lu ms)\n", complexity_cap_ns / 1000000);
+    }
+    if (nb < 3) {
+        printf("\x1B[33m\tNot enough points to fit an exponent\n\n\e[0m");
+        return;
+    }
+    double mine = fit_exponent(points, nb, cx->grow_m, 0);
+    double libc = fit_exponent(points, nb, cx->grow_m, 1);
+    // With a fixed haystack, a linear search does not depend on m at all
+    double limit = cx->grow_m ? complexity_limit - 1 : complexity_limit;
+    printf("\tExponent:    [%.2f]\n", mine);
+    printf("\tglibc:       [%.2f]\n", libc);
+    if (mine > limit) {
+        printf("\x1B[31m\tSuper-linear: time grows as %s^%.2f\n\n\e[0m",
+               cx->grow_m ? "m" : "n", mine);
+        failure++;
+    } else {
+        puts("");
+        success++;
+    }
+}
+
+void run_complexities(int ac, char **av)
+{
+    struct bench_ctx ctx = {0};
+
+    measure_pin();
+    printf("--> Exponents fitted on the %d largest sizes, super-linear above %.2f\n\n",
+           COMPLEXITY_FIT, complexity_limit);
+    NOT_NULL(ctx.s1 = aligned_alloc(64, complexity_max + 64));
+    NOT_NULL(ctx.s2 = aligned_alloc(64, complexity_max + 64));
+    for (unsigned int i = 0; i < sizeof(COMPLEXITIES) / sizeof(COMPLEXITIES[0]); i++) {
+        if (is_selected(COMPLEXITIES[i].funcname, ac, av)) {
+            run_complexity(&COMPLEXITIES[i], &ctx);
+        }
+    }
+    free(ctx.s1);
+    free(ctx.s2);
+}
+
+/*
+
+Memory bandwidth
+memcpy, memset and memmove on 1 to --bandwidth threads at once, each one
+with its own buffers several times larger than the last level cache
+
+*/
+
+#define BANDWIDTH_MAX_THREADS 256
+
+int bandwidth_threads = 0;
+size_t bandwidth_size = 0;
+uint64_t bandwidth_time_ns = 1000 * 1000 * 1000;
+
+struct bandwidth_fn {
+    char *funcname;
+    void **sym;
+    void *libc;
+    measure_loop_t loop;
+};
+
+struct bandwidth_worker {
+    pthread_t thread;
+    pthread_barrier_t *barrier;
+    const struct bandwidth_fn *fn;
+    void *impl;
+    struct bench_ctx ctx;
+    int cpu;
+    uint64_t bytes;
+    uint64_t end_ns;
+};
+
+static const struct bandwidth_fn BANDWIDTH_FNS[] = {
+    {"memcpy", (void **)&my_memcpy, (void *)memcpy, bench_loop_memcpy},
+    {"memset", (void **)&my_memset, (void *)memset, bench_loop_memset},
+    {"memmove", (void **)&my_memmove, (void *)memmove, bench_loop_memmove},
+};
+
+static void *bandwidth_worker(void *arg)
+{
+    struct bandwidth_worker *w = arg;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    pthread_barrier_wait(w->barrier);
+    uint64_t start = measure_now_ns();
+    w->bytes = 0;
+    do {
+        w->fn->loop(w->impl, &w->ctx, 1);
+        w->bytes += w->ctx.n;
+        w->end_ns = measure_now_ns();
+    } while (w->end_ns - start < bandwidth_time_ns);
+    return NULL;
+}
+
+// Powers of two, then the maximum itself
+static int next_thread_count(int nb, int max)
+{
+    if (nb == max) {
+        return max + 1;
+    }
+    return nb * 2 > max ? max : nb * 2;
+}
+
+// Aggregate GB/s, from the common start to the last thread done
+static double bandwidth_run(struct bandwidth_worker *workers, int nb, void *impl)
+{
+    pthread_barrier_t barrier;
+    uint64_t bytes = 0;
+    uint64_t end = 0;
+
+    pthread_barrier_init(&barrier, NULL, nb + 1);
+    for (int i = 0; i < nb; i++) {
+        workers[i].barrier = &barrier;
+        workers[i].impl = impl;
+        assert(pthread_create(&workers[i].thread, NULL, bandwidth_worker, &workers[i]) == 0);
+    }
+    pthread_barrier_wait(&barrier);
+    uint64_t start = measure_now_ns();
+    for (int i = 0; i < nb; i++) {
+        pthread_join(workers[i].thread, NULL);
+        bytes += workers[i].bytes;
+        end = workers[i].end_ns > end ? workers[i].end_ns : end;
+    }
+    pthread_barrier_destroy(&barrier);
+    return (double)bytes / (end - start);
+}
+
+void run_bandwidth(const struct bandwidth_fn *fn, struct bandwidth_worker *workers)
+{
+    double mine_one = 0;
+    double libc_one = 0;
+
+    printf("|------------| Running bandwidth scaling for: [%s] |------------|\n\n",
+           fn->funcname);
+    if (*fn->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    printf("%10s | %10s | %10s | %10s | %10s | %s\n", "threads", "GB/s", "glibc GB/s",
+           "efficiency", "glibc", "speedup");
+    for (int nb = 1; nb <= bandwidth_threads; nb = next_thread_count(nb, bandwidth_threads)) {
+        for (int i = 0; i < nb; i++) {
+            workers[i].fn = fn;
+        }
+        double mine = bandwidth_run(workers, nb, *fn->sym);
+        double libc = bandwidth_run(workers, nb, fn->libc);
+        if (nb == 1) {
+            mine_one = mine;
+            libc_one = libc;
+        }
+        printf("%10d | %10.2f | %10.2f | %9.1f%% | %9.1f%% | %s%6.2fx\e[0m\n", nb, mine, libc,
+               mine / (nb * mine_one) * 100, libc / (nb * libc_one) * 100,
+               mine >= libc ? "\x1B[32m" : "\x1B[31m", mine / libc);
+    }
+    puts("");
+}
+
+void run_bandwidths(int ac, char **av)
+{
+    struct bandwidth_worker *workers;
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    // Two buffers per thread, in at most half of the memory still available
+    size_t memory = (size_t)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+    size_t largest = memory / (2 * bandwidth_threads) / 4096 * 4096;
+    int cpus[CPU_SETSIZE];
+    int nb_cpus = 0;
+
+    if (bandwidth_size == 0) {
+        bandwidth_size = llc > 0 ? 4 * llc : 256 << 20;
+        bandwidth_size = bandwidth_size > (512 << 20) ? 512 << 20 : bandwidth_size;
+    }
+    if (bandwidth_size > largest) {
+        printf("\x1B[33m--> Only %lu MB of memory available: "
+               "buffers cut from %lu MB to %lu MB\n\e[0m",
+               memory * 2 >> 20, bandwidth_size >> 20, largest >> 20);
+        bandwidth_size = largest;
+    }
+    if (bandwidth_size < 4096) {
+        printf("\x1B[31m--> Not enough memory for %d threads\n\e[0m", bandwidth_threads);
+        return;
+    }
+    measure_save_allowed();
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (measure_allowed_saved ? CPU_ISSET(cpu, &measure_allowed)
+                                  : cpu < sysconf(_SC_NPROCESSORS_ONLN)) {
+            cpus[nb_cpus++] = cpu;
+        }
+    }
+    printf("--> Last level cache: %ld KB, %lu MB per buffer and per thread, %lu ms per run, "
+           "%d CPUs allowed\n\n", llc / 1024, bandwidth_size >> 20, bandwidth_time_ns / 1000000,
+           nb_cpus);
+    NOT_NULL(workers = calloc(bandwidth_threads, sizeof(*workers)));
+    for (int i = 0; i < bandwidth_threads; i++) {
+        workers[i].cpu = cpus[i % nb_cpus];
+        NOT_NULL(workers[i].ctx.s1 = aligned_alloc(4096, bandwidth_size));
+        NOT_NULL(workers[i].ctx.s2 = aligned_alloc(4096, bandwidth_size));
+        // Touch every page so the first run does not pay for the page faults
+        memset(workers[i].ctx.s1, 0, bandwidth_size);
+        memset(workers[i].ctx.s2, 'a', bandwidth_size);
+        workers[i].ctx.n = bandwidth_size;
+        workers[i].ctx.c = 'e';
+    }
+    for (unsigned int i = 0; i < sizeof(BANDWIDTH_FNS) / sizeof(BANDWIDTH_FNS[0]); i++) {
+        if (is_selected(BANDWIDTH_FNS[i].funcname, ac, av)) {
+            run_bandwidth(&BANDWIDTH_FNS[i], workers);
+        }
+    }
+    for (int i = 0; i < bandwidth_threads; i++) {
+        free(workers[i].ctx.s1);
+        free(workers[i].ctx.s2);
+    }
+    free(workers);
+}
+
+/*
+
+Mapped files
+strlen, strchr, strrchr and memfrob over the whole of a mapped file, generated or given
+with --mapped=FILE, counting the page faults of mapping and reading it.
+A file holding NUL bytes is taken as a sequence of strings
+
+*/
+
+#define MAPPED_PASSES 7
+#define MAPPED_HUGE_PAGE (2 << 20)
+
+enum {
+    MAPPED_POPULATE,
+    MAPPED_HUGE,
+    MAPPED_SEQUENTIAL,
+    MAPPED_WILLNEED,
+    MAPPED_UNCACHED,
+    NB_MAPPED_HINTS,
+};
+
+static const char *MAPPED_HINTS[] = {"populate", "huge", "sequential", "willneed", "uncached"};
+
+int mapped_mode = 0;
+char *mapped_path = NULL;
+size_t mapped_size = 256 << 20;
+int mapped_hints = 0;
+
+struct mapped_fn {
+    char *funcname;
+    void **sym;
+    void *libc;
+    void (*pass)(void *fn, char *p, char *end);
+    int writes;
+};
+
+struct mapped_pass {
+    double ns;
+    double minflt;
+    double majflt;
+};
+
+void parse_mapped_hints(char *arg)
+{
+    for (char *item = strtok(arg, ","); item != NULL; item = strtok(NULL, ",")) {
+        int hint = NB_MAPPED_HINTS;
+        for (int i = 0; i < NB_MAPPED_HINTS; i++) {
+            if (strcmp(item, MAPPED_HINTS[i]) == 0) {
+                hint = i;
+            }
+        }
+        if (hint == NB_MAPPED_HINTS) {
+            printf("Unknown mapping hint: [%s]!\n", item);
+            exit(1);
+        }
+        mapped_hints |= 1 << hint;
+    }
+}
+
+static void mapped_strlen(void *fn, char *p, char *end)
+{
+    __typeof__(my_strlen) f = fn;
+
+    while (p < end) {
+        p += f(p) + 1;
+    }
+}
+
+// Line by line, as when splitting a log
+static void mapped_strchr(void *fn, char *p, char *end)
+{
+    __typeof__(my_strchr) f = fn;
+
+    while (p < end) {
+        char *found = f(p, '\n');
+        p = found != NULL ? found + 1 : (char *)rawmemchr(p, '\0') + 1;
+    }
+}
+
+// The last line of each string: only what follows the last newline is scanned again
+static void mapped_strrchr(void *fn, char *p, char *end)
+{
+    __typeof__(my_strrchr) f = fn;
+
+    while (p < end) {
+        char *found = f(p, '\n');
+        p = (char *)rawmemchr(found != NULL ? found : p, '\0') + 1;
+    }
+}
+
+static void mapped_memfrob(void *fn, char *p, char *end)
+{
+    __typeof__(my_memfrob) f = fn;
+
+    f(p, end - p);
+}
+
+static const struct mapped_fn MAPPED_FNS[] = {
+    {"strlen", (void **)&my_strlen, (void *)strlen, mapped_strlen, 0},
+    {"strchr", (void **)&my_strchr, (void *)strchr, mapped_strchr, 0},
+    {"strrchr", (void **)&my_strrchr, (void *)strrchr, mapped_strrchr, 0},
+    {"memfrob", (void **)&my_memfrob, (void *)memfrob, mapped_memfrob, 1},
+};
+
+// Log lines, without any NUL byte. Synced so that uncached can drop its pages
+static int mapped_generate(size_t size)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    char path[PATH_MAX];
+    char *chunk;
+    size_t len = 0;
+
+    snprintf(path, sizeof(path), "%s/minilibc-mapped-XXXXXX", tmpdir ? tmpdir : "/tmp");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    unlink(path);
+    NOT_NULL(chunk = malloc(1 << 20));
+    while (len < (1 << 20) - 128) {
+        len += sprintf(chunk + len,
+                       "2024-05-%02d %02d:%02d:%02d INFO worker[%d] request %d done in %d ms\n",
+                       rand() % 28 + 1, rand() % 24, rand() % 60, rand() % 60, rand() % 64,
+                       rand(), rand() % 1000);
+    }
+    for (size_t done = 0; done < size;) {
+        size_t n = size - done < len ? size - done : len;
+        assert(write(fd, chunk, n) == (ssize_t)n);
+        done += n;
+    }
+    free(chunk);
+    assert(fsync(fd) == 0);
+    return fd;
+}
+
+// Read only, but for memfrob which writes a private copy. A zero page reserved after
+// the file ends the last string without writing into the mapping
+static char *mapped_map(const struct mapped_fn *fn, int fd, size_t size, size_t *mapped)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    int prot = fn->writes ? PROT_READ | PROT_WRITE : PROT_READ;
+    char *p = MAP_FAILED;
+
+    if (mapped_hints & (1 << MAPPED_HUGE)) {
+        // Files outside hugetlbfs can not have huge pages: read the file into an anonymous mapping
+        *mapped = (size + 1 + MAPPED_HUGE_PAGE - 1) / MAPPED_HUGE_PAGE * MAPPED_HUGE_PAGE;
+        p = mmap(NULL, *mapped, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) {
+            p = mmap(NULL, *mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            assert(p != MAP_FAILED);
+            madvise(p, *mapped, MADV_HUGEPAGE);
+        }
+        for (size_t done = 0; done < size;) {
+            ssize_t n = pread(fd, p + done, size - done, done);
+            assert(n > 0);
+            done += n;
+        }
+    } else {
+        int populate = mapped_hints & (1 << MAPPED_POPULATE) ? MAP_POPULATE : 0;
+        *mapped = (size + page - 1) / page * page + page;
+        p = mmap(NULL, *mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(p != MAP_FAILED);
+        assert(mmap(p, size, prot, MAP_PRIVATE | MAP_FIXED | populate, fd, 0) == p);
+    }
+    if (mapped_hints & (1 << MAPPED_SEQUENTIAL)) {
+        madvise(p, size, MADV_SEQUENTIAL);
+    }
+    if (mapped_hints & (1 << MAPPED_WILLNEED)) {
+        madvise(p, size, MADV_WILLNEED);
+    }
+    return p;
+}
+
+// Mapping and reading the whole file, from the page cache unless it is dropped first
+static void mapped_run(const struct mapped_fn *fn, void *impl, int fd, size_t size,
+                       struct mapped_pass *pass)
+{
+    struct rusage before;
+    struct rusage after;
+    size_t mapped;
+
+    if (mapped_hints & (1 << MAPPED_UNCACHED)) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    getrusage(RUSAGE_SELF, &before);
+    uint64_t start = measure_now_ns();
+    char *p = mapped_map(fn, fd, size, &mapped);
+    fn->pass(impl, p, p + size);
+    pass->ns = measure_now_ns() - start;
+    getrusage(RUSAGE_SELF, &after);
+    pass->minflt = after.ru_minflt - before.ru_minflt;
+    pass->majflt = after.ru_majflt - before.ru_majflt;
+    munmap(p, mapped);
+}
+
+static int compare_passes(const void *a, const void *b)
+{
+    return compare_doubles(&((const struct mapped_pass *)a)->ns,
+                           &((const struct mapped_pass *)b)->ns);
+}
+
+// Median pass of the library and of glibc, interleaved
+static void print_mapped_row(const char *impl, const struct mapped_pass *p, size_t size)
+{
+    printf("%10s | %8.2f | %10.0f | %10.0f | %10.2f\n", impl, size / p->ns, p->minflt,
+           p->majflt, p->ns / 1e6);
+}
+
+void run_mapped(const struct mapped_fn *fn, int fd, size_t size)
+{
+    struct mapped_pass mine[MAPPED_PASSES];
+    struct mapped_pass libc[MAPPED_PASSES];
+
+    printf("|------------| Running mapped benchmark for: [%s] |------------|\n\n", fn->funcname);
+    if (*fn->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    for (int i = 0; i < MAPPED_PASSES; i++) {
+        mapped_run(fn, *fn->sym, fd, size, &mine[i]);
+        mapped_run(fn, fn->libc, fd, size, &libc[i]);
+    }
+    qsort(mine, MAPPED_PASSES, sizeof(*mine), compare_passes);
+    qsort(libc, MAPPED_PASSES, sizeof(*libc), compare_passes);
+    printf("%10s | %8s | %10s | %10s | %10s\n", "", "GB/s", "minor flt", "major flt", "ms");
+    print_mapped_row("library", &mine[MAPPED_PASSES / 2], size);
+    print_mapped_row("glibc", &libc[MAPPED_PASSES / 2], size);
+    double speedup = libc[MAPPED_PASSES / 2].ns / mine[MAPPED_PASSES / 2].ns;
+    printf("\tSpeedup:     [%s%.2fx\e[0m]\n\n", speedup >= 1 ? "\x1B[32m" : "\x1B[31m", speedup);
+}
+
+void run_mappeds(int ac, char **av)
+{
+    struct statfs fs;
+    struct stat st;
+    int fd;
+
+    if (mapped_path != NULL) {
+        fd = open(mapped_path, O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+            printf("\x1B[31m--> Could not map [%s]: %s\n\e[0m", mapped_path,
+                   fd < 0 ? strerror(errno) : "empty file");
+            return;
+        }
+        mapped_size = st.st_size;
+    } else {
+        fd = mapped_generate(mapped_size);
+    }
+    // tmpfs pages are never read from a disk, and can not be dropped from the page cache
+    if (fstatfs(fd, &fs) == 0 && fs.f_type == TMPFS_MAGIC) {
+        printf("\x1B[33m--> The file is on tmpfs: no major faults%s, "
+               "set TMPDIR to a disk for a generated file\n\e[0m",
+               mapped_hints & (1 << MAPPED_UNCACHED) ? ", [uncached] ignored" : "");
+        mapped_hints &= ~(1 << MAPPED_UNCACHED);
+    }
+    measure_pin();
+    printf("--> Mapping %s of %lu MB, %d passes, hints:",
+           mapped_path ? mapped_path : "a generated log", mapped_size >> 20, MAPPED_PASSES);
+    for (int i = 0; i < NB_MAPPED_HINTS; i++) {
+        if (mapped_hints & (1 << i)) {
+            printf(" [%s]", MAPPED_HINTS[i]);
+        }
+    }
+    printf("%s\n--> Times and faults include the mmap, medians of the passes\n\n",
+           mapped_hints ? "" : " [none]");
+    for (unsigned int i = 0; i < sizeof(MAPPED_FNS) / sizeof(MAPPED_FNS[0]); i++) {
+        if (is_selected(MAPPED_FNS[i].funcname, ac, av)) {
+            run_mapped(&MAPPED_FNS[i], fd, mapped_size);
+        }
+    }
+    close(fd);
+}
+
+/*
+
+Guard pages
+Every input ends right before a PROT_NONE page, at each distance (slack)
+from 0 to 63 bytes, so any load past the end of the data faults.
+The fault is caught and reported as an over-read instead of a crash
+
+*/
+
+#define GUARD_SLACK 64
+
+int guard_max_len = -1;
+size_t guard_huge = SIZE_MAX;
+sigjmp_buf guard_jmp;
+
+struct guard_region {
+    char *base;
+    char *end;
+    size_t size;
+};
+
+struct guard {
+    char *funcname;
+    void **sym;
+    int (*check)(char *, char *, size_t, size_t);
+};
+
+void guard_map(struct guard_region *g, size_t data_size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t pages = (data_size + page - 1) / page;
+
+    g->size = (pages + 1) * page;
+    g->base = mmap(NULL, g->size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(g->base != MAP_FAILED);
+    g->end = g->base + pages * page;
+    assert(mprotect(g->end, page, PROT_NONE) == 0);
+}
+
+// A string of len letters whose terminator is slack bytes before end
+static char *guard_string(char *end, size_t len, size_t slack)
+{
+    char *s = end - slack - len - 1;
+
+    memset(s + len, 'x', slack + 1);
+    fill_letters(s, len);
+    return s;
+}
+
+// len letters, without a terminator, ending slack bytes before end
+static char *guard_buffer(char *end, size_t len, size_t slack)
+{
+    char *buf = end - slack - len;
+
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = 'a' + i % 26;
+    }
+    return buf;
+}
+
+static void guard_fault(int signum)
+{
+    siglongjmp(guard_jmp, signum);
+}
+
+static int guard_strlen(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *s = guard_string(e1, len, slack);
+
+    (void)e2;
+    return my_strlen(s) != strlen(s);
+}
+
+static int guard_strchr(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *s = guard_string(e1, len, slack);
+
+    (void)e2;
+    return my_strchr(s, '#') != strchr(s, '#')
+        || my_strchr(s, '\0') != strchr(s, '\0')
+        || my_strchr(s, 'a') != strchr(s, 'a');
+}
+
+static int guard_strrchr(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *s = guard_string(e1, len, slack);
+
+    (void)e2;
+    return my_strrchr(s, '#') != strrchr(s, '#')
+        || my_strrchr(s, '\0') != strrchr(s, '\0')
+        || my_strrchr(s, 'a') != strrchr(s, 'a');
+}
+
+static int guard_strcmp(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *s1 = guard_string(e1, len, slack);
+    char *s2 = guard_string(e2, len, GUARD_SLACK - 1 - slack);
+
+    if (!same_strcmp(my_strcmp(s1, s2), s1, s2)) {
+        return 1;
+    }
+    if (len > 0) {
+        s2[len - 1] = 'A';
+    }
+    return !same_strcmp(my_strcmp(s1, s2), s1, s2);
+}
+
+static int guard_strncmp(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *s1 = guard_string(e1, len, slack);
+    char *s2 = guard_string(e2, len, GUARD_SLACK - 1 - slack);
+
+    return !same_strncmp(my_strncmp(s1, s2, len + GUARD_SLACK), s1, s2, len + GUARD_SLACK)
+        || !same_strncmp(my_strncmp(s1, s2, guard_huge), s1, s2, guard_huge);
+}
+
+static int guard_strcasecmp(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *s1 = guard_string(e1, len, slack);
+    char *s2 = guard_string(e2, len, GUARD_SLACK - 1 - slack);
+
+    for (size_t i = 0; i < len; i += 2) {
+        s2[i] -= 'a' - 'A';
+    }
+    return !same_strcasecmp(my_strcasecmp(s1, s2), s1, s2);
+}
+
+static int guard_strstr(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *s = guard_string(e1, len, slack);
+    char *needle = guard_buffer(e2, 3, slack);
+
+    strcpy(needle, "a#");
+    if (my_strstr(s, needle) != strstr(s, needle)) {
+        return 1;
+    }
+    needle = s + len - (len < 8 ? len : 8);
+    return my_strstr(s, needle) != strstr(s, needle);
+}
+
+static int guard_strpbrk(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *s = guard_string(e1, len, slack);
+    char *accept = guard_buffer(e2, 3, slack);
+
+    strcpy(accept, "#$");
+    if (my_strpbrk(s, accept) != strpbrk(s, accept)) {
+        return 1;
+    }
+    accept = s + len - (len < 2 ? len : 2);
+    return my_strpbrk(s, accept) != strpbrk(s, accept);
+}
+
+static int guard_strcspn(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *s = guard_string(e1, len, slack);
+    char *reject = guard_buffer(e2, 3, slack);
+
+    strcpy(reject, "#$");
+    if (my_strcspn(s, reject) != strcspn(s, reject)) {
+        return 1;
+    }
+    reject = s + len - (len < 2 ? len : 2);
+    return my_strcspn(s, reject) != strcspn(s, reject);
+}
+
+static int guard_memset(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *dst = guard_buffer(e1, len, slack);
+
+    (void)e2;
+    my_memset(dst, '*', len);
+    for (size_t i = 0; i < len; i++) {
+        if (dst[i] != '*') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int guard_memcpy(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *dst = guard_buffer(e1, len, slack);
+    char *src = guard_buffer(e2, len, GUARD_SLACK - 1 - slack);
+
+    memset(dst, 0, len);
+    my_memcpy(dst, src, len);
+    return memcmp(dst, src, len) != 0;
+}
+
+static int guard_memmove(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *dst = guard_buffer(e1, len, slack);
+    char *src = guard_buffer(e2, len, GUARD_SLACK - 1 - slack);
+
+    memset(dst, 0, len);
+    my_memmove(dst, src, len);
+    if (memcmp(dst, src, len) != 0) {
+        return 1;
+    }
+    // Overlapping move ending on the guard page
+    memcpy(src, dst, len);
+    my_memmove(dst + (len > 0), dst, len - (len > 0));
+    return len > 1 && memcmp(dst + 1, src, len - 1) != 0;
+}
+
+static int guard_memfrob(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *buf = guard_buffer(e1, len, slack);
+
+    (void)e2;
+    my_memfrob(buf, len);
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] != (char)(('a' + i % 26) ^ 42)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int guard_strfry(char *e1, char *e2, size_t len, size_t slack)
+{
+    char *s = guard_string(e1, len, slack);
+
+    (void)e2;
+    return strlen(my_strfry(s)) != len;
+}
+
+#define GUARD(name) {#name, (void **)&my_##name, guard_##name}
+
+static const struct guard GUARDS[] = {
+    GUARD(strlen),
+    GUARD(strchr),
+    GUARD(strrchr),
+    GUARD(memset),
+    GUARD(memcpy),
+    GUARD(strcmp),
+    GUARD(memmove),
+    GUARD(strncmp),
+    GUARD(strcasecmp),
+    GUARD(strstr),
+    GUARD(strpbrk),
+    GUARD(strcspn),
+    GUARD(memfrob),
+    GUARD(strfry),
+};
+
+void run_guard(const struct guard *g, struct guard_region *r1, struct guard_region *r2)
+{
+    volatile int mismatches = 0;
+    volatile int faults = 0;
+    volatile size_t len = 0;
+    volatile size_t slack = 0;
+
+    printf("|------------| Running guard page suite for: [%s] |------------|\n\n",
+           g->funcname);
+    if (*g->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    for (len = 0; len <= (size_t)guard_max_len; len++) {
+        for (slack = 0; slack < GUARD_SLACK; slack++) {
+            int signum = sigsetjmp(guard_jmp, 1);
+            if (signum != 0) {
+                if (faults++ == 0) {
+                    printf("\tOver-read:  [length (%lu), %lu bytes before the guard page,"
+                           " signal (%d)]\n", len, slack, signum);
+                }
+                continue;
+            }
+            if (g->check(r1->end, r2->end, len, slack) && mismatches++ == 0) {
+                printf("\tMismatch:   [length (%lu), %lu bytes before the guard page]\n",
+                       len, slack);
+            }
+        }
+    }
+    printf("\tCases:      [%d]\n", (guard_max_len + 1) * GUARD_SLACK);
+    printf("\tOver-reads: [%d]\n", faults);
+    printf("\tMismatches: [%d]\n\n", mismatches);
+    if (faults || mismatches) {
+        failure++;
+    } else {
+        success++;
+    }
+}
+
+void run_guard_tests(int ac, char **av)
+{
+    struct sigaction fault = {0};
+    struct sigaction old_segv;
+    struct sigaction old_bus;
+    struct guard_region r1;
+    struct guard_region r2;
+
+    guard_map(&r1, guard_max_len + GUARD_SLACK + 1);
+    guard_map(&r2, guard_max_len + GUARD_SLACK + 1);
+    fault.sa_handler = guard_fault;
+    sigaction(SIGSEGV, &fault, &old_segv);
+    sigaction(SIGBUS, &fault, &old_bus);
+    for (unsigned int i = 0; i < sizeof(GUARDS) / sizeof(GUARDS[0]); i++) {
+        if (is_selected(GUARDS[i].funcname, ac, av)) {
+            run_guard(&GUARDS[i], &r1, &r2);
+        }
+    }
+    sigaction(SIGSEGV, &old_segv, NULL);
+    sigaction(SIGBUS, &old_bus, NULL);
+    munmap(r1.base, r1.size);
+    munmap(r2.base, r2.size);
+}
+
+/*
+
+Alignment matrix
+memcpy, memmove and memset on every source and destination misalignment
+from 0 to 63, on lengths around each size class, and on forward and backward
+overlaps for memmove. Each cell is checked against glibc and timed
+
+*/
+
+#define MATRIX_ALIGNS 64
+#define MATRIX_MARGIN 64
+#define MATRIX_WORST 10
+// Every length up to 64, then at most 4 per power of two of a size_t
+#define MATRIX_LENGTHS (65 + 4 * 64)
+
+int matrix_mode = 0;
+size_t matrix_max = 8192;
+size_t matrix_large = 4 << 20;
+FILE *matrix_csv = NULL;
+
+struct matrix_cell {
+    size_t len;
+    int src_align;
+    int dst_align;
+    long overlap;
+    int ok;
+    double mine;
+    double libc;
+};
+
+struct matrix_fn {
+    char *funcname;
+    void **sym;
+    void *libc;
+    void (*call)(void *, char *, char *, size_t);
+    int has_src;
+    int has_overlap;
+};
+
+struct matrix_state {
+    const struct matrix_fn *fn;
+    char *work;
+    char *ref;
+    int wrong;
+    struct matrix_cell worst[MATRIX_WORST];
+    int nb_worst;
+    double *speedups;
+    int nb_speedups;
+};
+
+static void matrix_call_memcpy(void *fn, char *dst, char *src, size_t len)
+{
+    ((__typeof__(my_memcpy))fn)(dst, src, len);
+}
+
+static void matrix_call_memmove(void *fn, char *dst, char *src, size_t len)
+{
+    ((__typeof__(my_memmove))fn)(dst, src, len);
+}
+
+static void matrix_call_memset(void *fn, char *dst, char *src, size_t len)
+{
+    (void)src;
+    ((__typeof__(my_memset))fn)(dst, 0x5a, len);
+}
+
+static const struct matrix_fn MATRIX_FNS[] = {
+    {"memcpy", (void **)&my_memcpy, (void *)memcpy, matrix_call_memcpy, 1, 0},
+    {"memmove", (void **)&my_memmove, (void *)memmove, matrix_call_memmove, 1, 1},
+    {"memset", (void **)&my_memset, (void *)memset, matrix_call_memset, 0, 0},
+};
+
+// Lengths: all of them up to 64, then around every power of two and its midpoint
+static size_t matrix_lengths(size_t *lengths)
+{
+    size_t n = 0;
+
+    for (size_t len = 0; len <= 64 && len <= matrix_max; len++) {
+        lengths[n++] = len;
+    }
+    for (size_t p = 128; p != 0 && p <= matrix_max; p *= 2) {
+        size_t around[] = {p / 2 + p / 4, p - 1, p, p + 1};
+        for (size_t i = 0; i < sizeof(around) / sizeof(*around); i++) {
+            if (around[i] > lengths[n - 1] && around[i] <= matrix_max) {
+                lengths[n++] = around[i];
+            }
+        }
+    }
+    return n;
+}
+
+static double matrix_time(const struct matrix_state *st, void *fn, char *dst,
+    char *src, size_t len)
+{
+    size_t reps = 1 + 2048 / (len + 64);
+    uint64_t best = UINT64_MAX;
+    unsigned int aux;
+
+    for (int round = 0; round < 3; round++) {
+        uint64_t start = __rdtscp(&aux);
+        for (size_t i = 0; i < reps; i++) {
+            st->fn->call(fn, dst, src, len);
+        }
+        uint64_t cycles = __rdtscp(&aux) - start;
+        best = cycles < best ? cycles : best;
+    }
+    return (double)best / reps;
+}
+
+static void matrix_keep_worst(struct matrix_state *st, const struct matrix_cell *cell)
+{
+    int i = st->nb_worst < MATRIX_WORST ? st->nb_worst++ : MATRIX_WORST - 1;
+
+    if (i == MATRIX_WORST - 1 && st->nb_worst == MATRIX_WORST
+        && cell->libc / cell->mine >= st->worst[i].libc / st->worst[i].mine) {
+        return;
+    }
+    for (; i > 0 && cell->libc / cell->mine < st->worst[i - 1].libc / st->worst[i - 1].mine; i--) {
+        st->worst[i] = st->worst[i - 1];
+    }
+    st->worst[i] = *cell;
+}
+
+static void print_matrix_cell(const struct matrix_cell *cell)
+{
+    printf("\t[length (%lu), src +%d, dst +%d, overlap (%ld)]: "
+           "%.1f cycles, glibc %.1f cycles, %s%.2fx\e[0m\n",
+           cell->len, cell->src_align, cell->dst_align, cell->overlap,
+           cell->mine, cell->libc,
+           cell->libc >= cell->mine ? "\x1B[32m" : "\x1B[31m", cell->libc / cell->mine);
+}
+
+// The same window is filled in work and ref, glibc runs on ref and the library on work
+static void matrix_cell(struct matrix_state *st, size_t src_off, size_t dst_off,
+    size_t len, struct matrix_cell *cell)
+{
+    size_t lo = (src_off < dst_off ? src_off : dst_off) - MATRIX_MARGIN;
+    size_t hi = (src_off > dst_off ? src_off : dst_off) + len + MATRIX_MARGIN;
+    char *work = st->work;
+    char *ref = st->ref;
+
+    for (size_t i = lo; i < hi; i++) {
+        work[i] = (char)(i * 131 + len);
+    }
+    memcpy(ref + lo, work + lo, hi - lo);
+    st->fn->call(st->fn->libc, ref + dst_off, ref + src_off, len);
+    st->fn->call(*st->fn->sym, work + dst_off, work + src_off, len);
+    cell->len = len;
+    cell->ok = memcmp(work + lo, ref + lo, hi - lo) == 0;
+    cell->mine = matrix_time(st, *st->fn->sym, work + dst_off, work + src_off, len);
+    cell->libc = matrix_time(st, st->fn->libc, ref + dst_off, ref + src_off, len);
+    if (!cell->ok && st->wrong++ < MATRIX_WORST) {
+        printf("\x1B[31m\tWrong:\e[0m");
+        print_matrix_cell(cell);
+    }
+    if (matrix_csv != NULL) {
+        fprintf(matrix_csv, "%s,%lu,%d,%d,%ld,%d,%.2f,%.2f\n", st->fn->funcname,
+                len, cell->src_align, cell->dst_align, cell->overlap, cell->ok,
+                cell->mine, cell->libc);
+    }
+    st->speedups[st->nb_speedups++] = cell->libc / cell->mine;
+    matrix_keep_worst(st, cell);
+}
+
+static void matrix_length(struct matrix_state *st, size_t len, const int *aligns, int nb_aligns)
+{
+    size_t dst_base = (2 * MATRIX_MARGIN + len + MATRIX_ALIGNS + 63) & ~(size_t)63;
+    struct matrix_cell cell = {0};
+    const long distances[] = {1, 2, 3, 4, 7, 8, 15, 16, 31, 32, 63, 64, len / 2, len - 1};
+    long overlaps[sizeof(distances) / sizeof(*distances)];
+    int nb_overlaps = 0;
+
+    // len / 2 and len - 1 meet the fixed distances on short lengths: each cell runs once
+    for (unsigned int i = 0; i < sizeof(distances) / sizeof(*distances); i++) {
+        int seen = distances[i] <= 0 || distances[i] >= (long)len;
+        for (int j = 0; j < nb_overlaps && !seen; j++) {
+            seen = overlaps[j] == distances[i];
+        }
+        if (!seen) {
+            overlaps[nb_overlaps++] = distances[i];
+        }
+    }
+    st->nb_speedups = 0;
+    for (int s = 0; s < (st->fn->has_src ? nb_aligns : 1); s++) {
+        for (int d = 0; d < nb_aligns; d++) {
+            cell.src_align = st->fn->has_src ? aligns[s] : 0;
+            cell.dst_align = aligns[d];
+            cell.overlap = 0;
+            matrix_cell(st, MATRIX_MARGIN + cell.src_align, dst_base + cell.dst_align, len, &cell);
+        }
+    }
+    for (int s = 0; st->fn->has_overlap && s < nb_aligns; s++) {
+        for (int o = 0; o < nb_overlaps; o++) {
+            size_t base = MATRIX_MARGIN + MATRIX_ALIGNS + aligns[s];
+            cell.src_align = aligns[s];
+            // Forward: the destination is after the source
+            cell.dst_align = (aligns[s] + overlaps[o]) % MATRIX_ALIGNS;
+            cell.overlap = overlaps[o];
+            matrix_cell(st, base, base + overlaps[o], len, &cell);
+            // Backward: the destination is before the source
+            cell.dst_align = (aligns[s] + MATRIX_ALIGNS - overlaps[o] % MATRIX_ALIGNS) % MATRIX_ALIGNS;
+            cell.overlap = -overlaps[o];
+            matrix_cell(st, base + overlaps[o], base, len, &cell);
+        }
+    }
+    qsort(st->speedups, st->nb_speedups, sizeof(*st->speedups), compare_doubles);
+    printf("%10lu | %6d | %8.2fx | %8.2fx | %8.2fx\n", len, st->nb_speedups,
+           st->speedups[0], quantile(st->speedups, st->nb_speedups, 0.5),
+           st->speedups[st->nb_speedups - 1]);
+}
+
+void run_matrix(const struct matrix_fn *fn)
+{
+    static const int large_aligns[] = {0, 1, 15, 16, 31, 32, 63};
+    int aligns[MATRIX_ALIGNS];
+    size_t lengths[MATRIX_LENGTHS];
+    size_t nb_lengths = matrix_lengths(lengths);
+    size_t longest = matrix_large > matrix_max ? matrix_large : matrix_max;
+    size_t size = 2 * (longest + 4 * MATRIX_MARGIN + MATRIX_ALIGNS);
+    struct matrix_state st = {fn, NULL, NULL, 0, {{0}}, 0, NULL, 0};
+
+    printf("|------------| Running alignment matrix for: [%s] |------------|\n\n",
+           fn->funcname);
+    if (*fn->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    NOT_NULL(st.work = aligned_alloc(64, size));
+    NOT_NULL(st.ref = aligned_alloc(64, size));
+    NOT_NULL(st.speedups = malloc(sizeof(double) * MATRIX_ALIGNS * MATRIX_ALIGNS * 2));
+    for (int i = 0; i < MATRIX_ALIGNS; i++) {
+        aligns[i] = i;
+    }
+    printf("%10s | %6s | %9s | %9s | %9s\n", "length", "cells", "worst", "median", "best");
+    for (size_t i = 0; i < nb_lengths; i++) {
+        matrix_length(&st, lengths[i], aligns, MATRIX_ALIGNS);
+    }
+    for (size_t len = matrix_max * 2; len <= matrix_large; len *= 2) {
+        matrix_length(&st, len, large_aligns, sizeof(large_aligns) / sizeof(*large_aligns));
+    }
+    printf("\n\tSlowest cells against glibc:\n");
+    for (int i = 0; i < st.nb_worst; i++) {
+        print_matrix_cell(&st.worst[i]);
+    }
+    printf("\tWrong cells: [%d]\n\n", st.wrong);
+    if (st.wrong) {
+        failure++;
+    } else {
+        success++;
+    }
+    free(st.work);
+    free(st.ref);
+    free(st.speedups);
+}
+
+void run_matrices(int ac, char **av)
+{
+    if (matrix_csv != NULL) {
+        fprintf(matrix_csv, "function,length,src_align,dst_align,overlap,ok,cycles,glibc_cycles\n");
+    }
+    for (unsigned int i = 0; i < sizeof(MATRIX_FNS) / sizeof(MATRIX_FNS[0]); i++) {
+        if (is_selected(MATRIX_FNS[i].funcname, ac, av)) {
+            run_matrix(&MATRIX_FNS[i]);
+        }
+    }
+    if (matrix_csv != NULL) {
+        fclose(matrix_csv);
+    }
+}
+
+/*
+
+Differential fuzzing
+Random and structured inputs go to both the library and glibc, and the
+first divergence is shrunk to a small reproducer. Nothing is printed and
+nothing sleeps while cases run
+
+*/
+
+#define FUZZ_MAX 512
+
+uint64_t fuzz_cases = 0;
+uint64_t fuzz_seed = 42;
+uint64_t fuzz_state = 42;
+
+struct fuzz_case {
+    char s1[FUZZ_MAX + 1];
+    char s2[FUZZ_MAX + 1];
+    size_t len1;
+    size_t len2;
+    size_t n;
+    size_t src;
+    size_t dst;
+    int c;
+};
+
+struct fuzz {
+    char *funcname;
+    void **sym;
+    void (*generate)(struct fuzz_case *);
+    int (*check)(struct fuzz_case *);
+    char *args;
+};
+
+char fuzz_buf1[FUZZ_MAX + 64];
+char fuzz_buf2[FUZZ_MAX + 64];
+
+static inline uint64_t fuzz_random(void)
+{
+    fuzz_state ^= fuzz_state >> 12;
+    fuzz_state ^= fuzz_state << 25;
+    fuzz_state ^= fuzz_state >> 27;
+    return fuzz_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Mostly short, sometimes up to FUZZ_MAX
+static size_t fuzz_len(void)
+{
+    uint64_t r = fuzz_random();
+
+    switch (r & 7) {
+    case 0:
+        return (r >> 8) % (FUZZ_MAX + 1);
+    case 1:
+    case 2:
+        return (r >> 8) % 65;
+    default:
+        return (r >> 8) % 17;
+    }
+}
+
+// Two letters for many partial matches, letters of both cases, high bytes, or anything
+static char fuzz_byte(int alphabet)
+{
+    uint64_t r = fuzz_random();
+
+    switch (alphabet) {
+    case 0:
+        return 'a' + (r & 1);
+    case 1:
+        return ((r & 1) ? 'a' : 'A') + (r >> 1) % 26;
+    case 2:
+        return (r & 1) ? (char)(0x80 | (r >> 1)) : (char)('a' + (r >> 1) % 4);
+    default:
+        return 1 + (r >> 1) % 255;
+    }
+}
+
+static void fuzz_string(char *s, size_t *len, size_t wanted)
+{
+    int alphabet = fuzz_random() % 4;
+
+    for (size_t i = 0; i < wanted; i++) {
+        s[i] = fuzz_byte(alphabet);
+    }
+    s[wanted] = '\0';
+    *len = wanted;
+}
+
+static void fuzz_gen_string(struct fuzz_case *fc)
+{
+    fuzz_string(fc->s1, &fc->len1, fuzz_len());
+    switch (fuzz_random() % 5) {
+    case 0:
+        fc->c = '\0';
+        break;
+    case 1:
+        fc->c = (int)(fuzz_random() % 256) - 128;
+        break;
+    case 2:
+        // Only the low byte counts
+        fc->c = fuzz_byte(3) + 256;
+        break;
+    default:
+        fc->c = fc->len1 ? fc->s1[fuzz_random() % fc->len1] : 'a';
+    }
+}
+
+// Long shared prefixes: the second string is a copy of the first with one change
+static void fuzz_gen_pair(struct fuzz_case *fc)
+{
+    uint64_t r = fuzz_random();
+
+    fuzz_string(fc->s1, &fc->len1, fuzz_len());
+    memcpy(fc->s2, fc->s1, fc->len1 + 1);
+    fc->len2 = fc->len1;
+    switch (r % 6) {
+    case 0:
+        fuzz_string(fc->s2, &fc->len2, fuzz_len());
+        break;
+    case 1:
+        fc->len2 = fc->len1 ? (r >> 8) % fc->len1 : 0;
+        fc->s2[fc->len2] = '\0';
+        break;
+    case 2:
+    case 3:
+        if (fc->len1) {
+            fc->s2[(r >> 8) % fc->len1] = fuzz_byte(2 + (r & 1));
+        }
+        break;
+    case 4:
+        for (size_t i = 0; i < fc->len2; i++) {
+            if (fuzz_random() & 1) {
+                fc->s2[i] ^= ((fc->s2[i] | 0x20) >= 'a' && (fc->s2[i] | 0x20) <= 'z') << 5;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    r = fuzz_random();
+    switch (r % 4) {
+    case 0:
+        fc->n = SIZE_MAX - (r >> 8) % 2;
+        break;
+    case 1:
+        fc->n = 0;
+        break;
+    default:
+        fc->n = fc->len1 + (r >> 8) % 5 - 2;
+        fc->n = fc->n > FUZZ_MAX + 2 ? 0 : fc->n;
+    }
+}
+
+// Needles cut out of the haystack, sometimes with one byte off
+static void fuzz_gen_needle(struct fuzz_case *fc)
+{
+    uint64_t r = fuzz_random();
+
+    fuzz_string(fc->s1, &fc->len1, fuzz_len());
+    if (r % 4 == 0 || fc->len1 == 0) {
+        fuzz_string(fc->s2, &fc->len2, fuzz_random() % 8);
+        return;
+    }
+    size_t start = (r >> 8) % fc->len1;
+    size_t len = fuzz_random() % (fc->len1 - start + 1);
+    memcpy(fc->s2, fc->s1 + start, len);
+    fc->s2[len] = '\0';
+    fc->len2 = len;
+    if (len && r % 4 == 1) {
+        fc->s2[fuzz_random() % len] ^= 1 + fuzz_random() % 3;
+        fc->s2[len] = '\0';
+        fc->len2 = strlen(fc->s2);
+    }
+}
+
+// Accept and reject sets of every size, from none to all 255 bytes
+static void fuzz_gen_set(struct fuzz_case *fc)
+{
+    unsigned char bytes[255];
+    size_t size = fuzz_random() % 4 ? fuzz_random() % 9 : fuzz_random() % 256;
+
+    fuzz_string(fc->s1, &fc->len1, fuzz_len());
+    for (int i = 0; i < 255; i++) {
+        bytes[i] = i + 1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        size_t j = i + fuzz_random() % (255 - i);
+        unsigned char tmp = bytes[i];
+        bytes[i] = bytes[j];
+        bytes[j] = tmp;
+        fc->s2[i] = bytes[i];
+    }
+    if (size && fc->len1 && fuzz_random() % 2) {
+        fc->s2[fuzz_random() % size] = fc->s1[fuzz_random() % fc->len1];
+    }
+    fc->s2[size] = '\0';
+    fc->len2 = size;
+}
+
+// Any bytes, zeros included, with a copy or a move somewhere inside
+static void fuzz_gen_buffer(struct fuzz_case *fc)
+{
+    fc->len1 = fuzz_len();
+    for (size_t i = 0; i < fc->len1; i++) {
+        fc->s1[i] = fuzz_random() % 4 ? (char)fuzz_random() : 0;
+    }
+    fc->s1[fc->len1] = '\0';
+    fc->n = fc->len1 ? fuzz_random() % (fc->len1 + 1) : 0;
+    fc->src = fuzz_random() % (fc->len1 - fc->n + 1);
+    fc->dst = fuzz_random() % (fc->len1 - fc->n + 1);
+    fc->c = (int)fuzz_random();
+}
+
+static void fuzz_gen_int(struct fuzz_case *fc)
+{
+    uint64_t r = fuzz_random();
+
+    switch (r % 4) {
+    case 0:
+        fc->c = 1U << ((r >> 8) % 32);
+        break;
+    case 1:
+        fc->c = 0;
+        break;
+    default:
+        fc->c = (int)((uint32_t)(r >> 16) << ((r >> 8) % 32));
+    }
+}
+
+static int fuzz_strlen(struct fuzz_case *fc)
+{
+    return my_strlen(fc->s1) != strlen(fc->s1);
+}
+
+static int fuzz_strchr(struct fuzz_case *fc)
+{
+    return my_strchr(fc->s1, fc->c) != strchr(fc->s1, fc->c);
+}
+
+static int fuzz_strrchr(struct fuzz_case *fc)
+{
+    return my_strrchr(fc->s1, fc->c) != strrchr(fc->s1, fc->c);
+}
+
+static int fuzz_strcmp(struct fuzz_case *fc)
+{
+    return !same_strcmp(my_strcmp(fc->s1, fc->s2), fc->s1, fc->s2);
+}
+
+static int fuzz_strncmp(struct fuzz_case *fc)
+{
+    return !same_strncmp(my_strncmp(fc->s1, fc->s2, fc->n), fc->s1, fc->s2, fc->n);
+}
+
+static int fuzz_strcasecmp(struct fuzz_case *fc)
+{
+    return !same_strcasecmp(my_strcasecmp(fc->s1, fc->s2), fc->s1, fc->s2);
+}
+
+static int fuzz_strstr(struct fuzz_case *fc)
+{
+    return my_strstr(fc->s1, fc->s2) != strstr(fc->s1, fc->s2);
+}
+
+static int fuzz_strpbrk(struct fuzz_case *fc)
+{
+    return my_strpbrk(fc->s1, fc->s2) != strpbrk(fc->s1, fc->s2);
+}
+
+static int fuzz_strcspn(struct fuzz_case *fc)
+{
+    return my_strcspn(fc->s1, fc->s2) != strcspn(fc->s1, fc->s2);
+}
+
+static int fuzz_memcpy(struct fuzz_case *fc)
+{
+    memset(fuzz_buf1, 0x55, fc->n + 16);
+    memset(fuzz_buf2, 0x55, fc->n + 16);
+    void *res = (void *)my_memcpy(fuzz_buf1, fc->s1 + fc->src, fc->n);
+    memcpy(fuzz_buf2, fc->s1 + fc->src, fc->n);
+    return res != fuzz_buf1 || memcmp(fuzz_buf1, fuzz_buf2, fc->n + 16) != 0;
+}
+
+static int fuzz_memset(struct fuzz_case *fc)
+{
+    memset(fuzz_buf1, 0x55, fc->n + 16);
+    memset(fuzz_buf2, 0x55, fc->n + 16);
+    void *res = my_memset(fuzz_buf1, fc->c, fc->n);
+    memset(fuzz_buf2, fc->c, fc->n);
+    return res != fuzz_buf1 || memcmp(fuzz_buf1, fuzz_buf2, fc->n + 16) != 0;
+}
+
+static int fuzz_memmove(struct fuzz_case *fc)
+{
+    memcpy(fuzz_buf1, fc->s1, fc->len1);
+    memcpy(fuzz_buf2, fc->s1, fc->len1);
+    void *res = my_memmove(fuzz_buf1 + fc->dst, fuzz_buf1 + fc->src, fc->n);
+    memmove(fuzz_buf2 + fc->dst, fuzz_buf2 + fc->src, fc->n);
+    return res != fuzz_buf1 + fc->dst || memcmp(fuzz_buf1, fuzz_buf2, fc->len1) != 0;
+}
+
+static int fuzz_memfrob(struct fuzz_case *fc)
+{
+    memcpy(fuzz_buf1, fc->s1, fc->len1);
+    memcpy(fuzz_buf2, fc->s1, fc->len1);
+    void *res = my_memfrob(fuzz_buf1, fc->n);
+    memfrob(fuzz_buf2, fc->n);
+    return res != fuzz_buf1 || memcmp(fuzz_buf1, fuzz_buf2, fc->len1) != 0;
+}
+
+static int fuzz_ffs(struct fuzz_case *fc)
+{
+    return my_ffs(fc->c) != ffs(fc->c);
+}
+
+// Not deterministic: only check that the result is a permutation of the input
+static int fuzz_strfry(struct fuzz_case *fc)
+{
+    size_t counts[256] = {0};
+
+    memcpy(fuzz_buf1, fc->s1, fc->len1 + 1);
+    if (my_strfry(fuzz_buf1) != fuzz_buf1 || strlen(fuzz_buf1) != fc->len1) {
+        return 1;
+    }
+    for (size_t i = 0; i < fc->len1; i++) {
+        counts[(unsigned char)fc->s1[i]]++;
+        counts[(unsigned char)fuzz_buf1[i]]--;
+    }
+    for (int i = 0; i < 256; i++) {
+        if (counts[i] != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// args: 1 and 2 for the strings, b for a buffer, n for the size, c for the int
+#define FUZZ(name, generate, args) {#name, (void **)&my_##name, generate, fuzz_##name, args}
+
+static const struct fuzz FUZZS[] = {
+    FUZZ(strlen, fuzz_gen_string, "1"),
+    FUZZ(strchr, fuzz_gen_string, "1c"),
+    FUZZ(strrchr, fuzz_gen_string, "1c"),
+    FUZZ(memset, fuzz_gen_buffer, "nc"),
+    FUZZ(memcpy, fuzz_gen_buffer, "bn"),
+    FUZZ(strcmp, fuzz_gen_pair, "12"),
+    FUZZ(memmove, fuzz_gen_buffer, "bn"),
+    FUZZ(strncmp, fuzz_gen_pair, "12n"),
+    FUZZ(strcasecmp, fuzz_gen_pair, "12"),
+    FUZZ(strstr, fuzz_gen_needle, "12"),
+    FUZZ(strpbrk, fuzz_gen_set, "12"),
+    FUZZ(strcspn, fuzz_gen_set, "12"),
+    FUZZ(ffs, fuzz_gen_int, "c"),
+    FUZZ(memfrob, fuzz_gen_buffer, "bn"),
+    FUZZ(strfry, fuzz_gen_string, "1"),
+};
+
+// A crash counts as a divergence
+static int fuzz_fails(const struct fuzz *f, struct fuzz_case *fc)
+{
+    if (sigsetjmp(guard_jmp, 1) != 0) {
+        return 1;
+    }
+    return f->check(fc);
+}
+
+static int fuzz_valid(const struct fuzz *f, const struct fuzz_case *fc)
+{
+    if (strchr(f->args, 'b')) {
+        return fc->src + fc->n <= fc->len1 && fc->dst + fc->n <= fc->len1
+            && fc->n <= fc->len1;
+    }
+    return 1;
+}
+
+static int fuzz_try(const struct fuzz *f, struct fuzz_case *fc, const struct fuzz_case *cand)
+{
+    if (!fuzz_valid(f, cand) || !fuzz_fails(f, (struct fuzz_case *)cand)) {
+        return 0;
+    }
+    *fc = *cand;
+    return 1;
+}
+
+static int fuzz_shrink_string(const struct fuzz *f, struct fuzz_case *fc, int second)
+{
+    struct fuzz_case cand;
+    int shrunk = 0;
+
+    for (size_t chunk = (second ? fc->len2 : fc->len1) / 2 + 1; chunk > 0; chunk /= 2) {
+        for (size_t pos = 0; pos + chunk <= (second ? fc->len2 : fc->len1); pos++) {
+            cand = *fc;
+            char *s = second ? cand.s2 : cand.s1;
+            size_t *len = second ? &cand.len2 : &cand.len1;
+            memmove(s + pos, s + pos + chunk, *len - pos - chunk + 1);
+            *len -= chunk;
+            shrunk |= fuzz_try(f, fc, &cand);
+        }
+    }
+    for (size_t i = 0; i < (second ? fc->len2 : fc->len1); i++) {
+        cand = *fc;
+        char *s = second ? cand.s2 : cand.s1;
+        if (s[i] != 'a') {
+            s[i] = 'a';
+            shrunk |= fuzz_try(f, fc, &cand);
+        }
+    }
+    return shrunk;
+}
+
+// Greedy: keep any smaller or simpler case that still diverges, until none does
+void fuzz_minimize(const struct fuzz *f, struct fuzz_case *fc)
+{
+    struct fuzz_case cand;
+    int shrunk = 1;
+
+    while (shrunk) {
+        shrunk = (strchr(f->args, '1') || strchr(f->args, 'b')) && fuzz_shrink_string(f, fc, 0);
+        shrunk |= strchr(f->args, '2') && fuzz_shrink_string(f, fc, 1);
+        size_t sizes[] = {fc->n / 2, fc->n - 1};
+        for (int i = 0; i < 2 && strchr(f->args, 'n') && fc->n > 0; i++) {
+            cand = *fc;
+            cand.n = sizes[i];
+            shrunk |= fuzz_try(f, fc, &cand);
+        }
+        int ints[] = {fc->c & (fc->c - 1), fc->c / 2, 'a'};
+        for (int i = 0; i < 3 && strchr(f->args, 'c') && fc->c != ints[i]; i++) {
+            cand = *fc;
+            cand.c = ints[i];
+            shrunk |= fuzz_try(f, fc, &cand);
+        }
+        for (int i = 0; i < 2 && (fc->src || fc->dst); i++) {
+            cand = *fc;
+            cand.src -= cand.src > 0;
+            cand.dst -= cand.dst > 0 && i;
+            shrunk |= fuzz_try(f, fc, &cand);
+        }
+    }
+}
+
+// As a C string literal, splitting it when a hex escape is followed by a hex digit
+static void print_escaped(const char *s, size_t len)
+{
+    int escaped = 0;
+
+    printf("\"");
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = s[i];
+        if (escaped && isxdigit(c)) {
+            printf("\"\"");
+        }
+        escaped = 0;
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (isprint(c)) {
+            printf("%c", c);
+        } else {
+            printf("\\x%02x", c);
+            escaped = 1;
+        }
+    }
+    printf("\"");
+}
+
+void print_fuzz_case(const struct fuzz *f, const struct fuzz_case *fc)
+{
+    printf("\tReproducer:  [%s]\n", f->funcname);
+    if (strchr(f->args, '1') || strchr(f->args, 'b')) {
+        printf("\t   s1:       [");
+        print_escaped(fc->s1, fc->len1);
+        printf("]\n");
+    }
+    if (strchr(f->args, '2')) {
+        printf("\t   s2:       [");
+        print_escaped(fc->s2, fc->len2);
+        printf("]\n");
+    }
+    if (strchr(f->args, 'n')) {
+        printf("\t   n:        [%lu]\n", fc->n);
+    }
+    if (strchr(f->args, 'c')) {
+        printf("\t   c:        [%d]\n", fc->c);
+    }
+    if (strchr(f->args, 'b') && strcmp(f->funcname, "memmove") == 0) {
+        printf("\t   move:     [s1 + %lu to s1 + %lu]\n", fc->src, fc->dst);
+    } else if (strchr(f->args, 'b') && fc->src) {
+        printf("\t   from:     [s1 + %lu]\n", fc->src);
+    }
+}
+
+void run_fuzz(const struct fuzz *f)
+{
+    static struct fuzz_case fc;
+    static struct fuzz_case first;
+    volatile uint64_t i = 0;
+    volatile uint64_t divergences = 0;
+
+    printf("|------------| Running fuzzer for: [%s] |------------|\n\n", f->funcname);
+    if (*f->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    fuzz_state = fuzz_seed ? fuzz_seed : 1;
+    // Fields the generator of this function does not set must not come from the previous one
+    memset(&fc, 0, sizeof(fc));
+    uint64_t start = measure_now_ns();
+    // Crashes land here once, instead of paying for a sigsetjmp per case
+    if (sigsetjmp(guard_jmp, 1) != 0) {
+        if (divergences++ == 0) {
+            first = fc;
+        }
+        i++;
+    }
+    for (; i < fuzz_cases; i++) {
+        f->generate(&fc);
+        if (f->check(&fc) && divergences++ == 0) {
+            first = fc;
+        }
+    }
+    double seconds = (measure_now_ns() - start) / 1e9;
+    printf("\tCases:       [%lu]\n", fuzz_cases);
+    printf("\tSpeed:       [%.2f M cases/s]\n", fuzz_cases / seconds / 1e6);
+    printf("\tDivergences: [%lu]\n", divergences);
+    if (divergences) {
+        fuzz_minimize(f, &first);
+        print_fuzz_case(f, &first);
+        failure++;
+    } else {
+        success++;
+    }
+    puts("");
+}
+
+void run_fuzzers(int ac, char **av)
+{
+    struct sigaction fault = {0};
+    struct sigaction old_segv;
+    struct sigaction old_bus;
+
+    printf("--> Fuzzing with seed %lu, %lu cases per function\n\n", fuzz_seed, fuzz_cases);
+    fault.sa_handler = guard_fault;
+    sigaction(SIGSEGV, &fault, &old_segv);
+    sigaction(SIGBUS, &fault, &old_bus);
+    for (unsigned int i = 0; i < sizeof(FUZZS) / sizeof(FUZZS[0]); i++) {
+        if (is_selected(FUZZS[i].funcname, ac, av)) {
+            run_fuzz(&FUZZS[i]);
+        }
+    }
+    sigaction(SIGSEGV, &old_segv, NULL);
+    sigaction(SIGBUS, &old_bus, NULL);
+}
+
+/*
+
+Exhaustive domains
+Every input of a small domain, split in chunks across threads: all 2^32
+ints for ffs, every pair of bytes for strcasecmp and strncmp
+
+*/
+
+#define EXHAUSTIVE_CHUNK (1 << 20)
+#define EXHAUSTIVE_KEEP 10
+
+int exhaustive_threads = 0;
+
+struct domain {
+    char *funcname;
+    void **sym;
+    uint64_t size;
+    uint64_t (*check)(uint64_t, uint64_t, uint64_t *, int *);
+    void (*print)(uint64_t);
+};
+
+struct exhaustive_run {
+    const struct domain *d;
+    uint64_t next;
+    pthread_mutex_t lock;
+    uint64_t mismatches;
+    uint64_t bad[EXHAUSTIVE_KEEP];
+    int nb_bad;
+};
+
+// Tight loops: the first mismatches of the chunk are kept, the others only counted
+#define EXHAUSTIVE_LOOP(name, setup, differs) \
+    static uint64_t exhaustive_##name(uint64_t begin, uint64_t end, uint64_t *bad, int *nb_bad) \
+    { \
+        uint64_t mismatches = 0; \
+        for (uint64_t i = begin; i < end; i++) { \
+            setup; \
+            if (differs) { \
+                if (*nb_bad < EXHAUSTIVE_KEEP) { \
+                    bad[(*nb_bad)++] = i; \
+                } \
+                mismatches++; \
+            } \
+        } \
+        return mismatches; \
+    }
+
+// Pairs of one byte strings for strcasecmp, and for strncmp with n from 0 to 3
+#define BYTE_PAIR(i) \
+    char s1[2] = {(char)((i) >> 8), '\0'}; \
+    char s2[2] = {(char)(i), '\0'}
+
+EXHAUSTIVE_LOOP(ffs, int x = (int)(uint32_t)i, my_ffs(x) != ffs(x))
+EXHAUSTIVE_LOOP(strcasecmp, BYTE_PAIR(i), !same_strcasecmp(my_strcasecmp(s1, s2), s1, s2))
+EXHAUSTIVE_LOOP(strncmp, BYTE_PAIR(i); size_t n = i >> 16,
+    !same_strncmp(my_strncmp(s1, s2, n), s1, s2, n))
+
+static void print_exhaustive_ffs(uint64_t i)
+{
+    int x = (int)(uint32_t)i;
+
+    printf("\t   ffs(%d): [%d], expected [%d]\n", x, my_ffs(x), ffs(x));
+}
+
+static void print_exhaustive_strcasecmp(uint64_t i)
+{
+    BYTE_PAIR(i);
+
+    printf("\t   strcasecmp(\"\\x%02x\", \"\\x%02x\"): [%d], expected [%d]\n",
+           (unsigned char)s1[0], (unsigned char)s2[0],
+           my_strcasecmp(s1, s2), strcasecmp(s1, s2));
+}
+
+static void print_exhaustive_strncmp(uint64_t i)
+{
+    BYTE_PAIR(i);
+    size_t n = i >> 16;
+
+    printf("\t   strncmp(\"\\x%02x\", \"\\x%02x\", %lu): [%d], expected [%d]\n",
+           (unsigned char)s1[0], (unsigned char)s2[0], n,
+           my_strncmp(s1, s2, n), strncmp(s1, s2, n));
+}
+
+#define DOMAIN(name, size) \
+    {#name, (void **)&my_##name, size, exhaustive_##name, print_exhaustive_##name}
+
+static const struct domain DOMAINS[] = {
+    DOMAIN(ffs, 1ULL << 32),
+    DOMAIN(strcasecmp, 1 << 16),
+    DOMAIN(strncmp, 4 << 16),
+};
+
+static void *exhaustive_worker(void *arg)
+{
+    struct exhaustive_run *run = arg;
+    uint64_t bad[EXHAUSTIVE_KEEP];
+
+    for (;;) {
+        uint64_t begin = __atomic_fetch_add(&run->next, EXHAUSTIVE_CHUNK, __ATOMIC_RELAXED);
+        if (begin >= run->d->size) {
+            return NULL;
+        }
+        uint64_t end = begin + EXHAUSTIVE_CHUNK < run->d->size
+            ? begin + EXHAUSTIVE_CHUNK : run->d->size;
+        int nb_bad = 0;
+        uint64_t mismatches = run->d->check(begin, end, bad, &nb_bad);
+        if (mismatches == 0) {
+            continue;
+        }
+        // Keep the smallest inputs, whatever order the chunks finish in
+        pthread_mutex_lock(&run->lock);
+        run->mismatches += mismatches;
+        for (int i = 0; i < nb_bad; i++) {
+            int j = run->nb_bad < EXHAUSTIVE_KEEP ? run->nb_bad++ : EXHAUSTIVE_KEEP;
+            for (; j > 0 && run->bad[j - 1] > bad[i]; j--) {
+                if (j < EXHAUSTIVE_KEEP) {
+                    run->bad[j] = run->bad[j - 1];
+                }
+            }
+            if (j < EXHAUSTIVE_KEEP) {
+                run->bad[j] = bad[i];
+            }
+        }
+        pthread_mutex_unlock(&run->lock);
+    }
+}
+
+void run_exhaustive(const struct domain *d)
+{
+    struct exhaustive_run run = {d, 0, PTHREAD_MUTEX_INITIALIZER, 0, {0}, 0};
+    pthread_t threads[BANDWIDTH_MAX_THREADS];
+
+    printf("|------------| Running exhaustive domain for: [%s] |------------|\n\n",
+           d->funcname);
+    if (*d->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    fflush(stdout);
+    uint64_t start = measure_now_ns();
+    for (int i = 0; i < exhaustive_threads; i++) {
+        assert(pthread_create(&threads[i], NULL, exhaustive_worker, &run) == 0);
+    }
+    for (int i = 0; i < exhaustive_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = (measure_now_ns() - start) / 1e9;
+    printf("\tInputs:      [%lu]\n", d->size);
+    printf("\tTime:        [%.2f s]\n", seconds);
+    printf("\tSpeed:       [%.2f M inputs/s]\n", d->size / seconds / 1e6);
+    printf("\tMismatches:  [%lu]\n", run.mismatches);
+    for (int i = 0; i < run.nb_bad; i++) {
+        d->print(run.bad[i]);
+    }
+    puts("");
+    if (run.mismatches) {
+        failure++;
+    } else {
+        success++;
+    }
+}
+
+void run_exhaustives(int ac, char **av)
+{
+    printf("--> Exhaustive domains on %d threads\n\n", exhaustive_threads);
+    for (unsigned int i = 0; i < sizeof(DOMAINS) / sizeof(DOMAINS[0]); i++) {
+        if (is_selected(DOMAINS[i].funcname, ac, av)) {
+            run_exhaustive(&DOMAINS[i]);
+        }
+    }
+}
+
+/*
+
+LD_PRELOAD runs
+Run a command as is, then with each library in LD_PRELOAD so its functions replace glibc's in the whole program.
+The variants take turns, and their wall, user and system times and peak RSS are compared
+
+*/
+
+int preload_runs = 0;
+
+struct preload_stats {
+    double wall[MEASURE_MAX_SAMPLES + 1];
+    double user[MEASURE_MAX_SAMPLES + 1];
+    double sys[MEASURE_MAX_SAMPLES + 1];
+    double rss[MEASURE_MAX_SAMPLES + 1];
+    uint64_t output;
+    int status;
+    int unstable;
+};
+
+static double timeval_ms(struct timeval tv)
+{
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+// Run the command once with preload in LD_PRELOAD (none if NULL), hashing its output
+void preload_run(char **av, const char *preload, struct preload_stats *st, int run)
+{
+    struct rusage usage;
+    uint64_t hash = 14695981039346656037ULL;
+    char buf[BUFSIZ];
+    ssize_t len;
+    int status;
+    int fds[2];
+
+    fflush(stdout);
+    assert(pipe(fds) == 0);
+    uint64_t start = measure_now_ns();
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        if (preload != NULL) {
+            setenv("LD_PRELOAD", preload, 1);
+        } else {
+            unsetenv("LD_PRELOAD");
+        }
+        execvp(av[0], av);
+        perror(av[0]);
+        _exit(127);
+    }
+    close(fds[1]);
+    while ((len = read(fds[0], buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < len; i++) {
+            hash = (hash ^ (unsigned char)buf[i]) * 1099511628211ULL;
+        }
+    }
+    close(fds[0]);
+    assert(wait4(pid, &status, 0, &usage) == pid);
+    st->wall[run] = (measure_now_ns() - start) / 1e6;
+    st->user[run] = timeval_ms(usage.ru_utime);
+    st->sys[run] = timeval_ms(usage.ru_stime);
+    st->rss[run] = usage.ru_maxrss;
+    if (run == 0) {
+        st->output = hash;
+        st->status = status;
+    } else if (hash != st->output || status != st->status) {
+        st->unstable = 1;
+    }
+}
+
+static double preload_median(double *samples)
+{
+    qsort(samples + 1, preload_runs, sizeof(*samples), compare_doubles);
+    return quantile(samples + 1, preload_runs, 0.5);
+}
+
+void print_preload_row(const char *name, struct preload_stats *st, const struct measurement *wall,
+                       const struct measurement *ref)
+{
+    char *colors[] = {"\x1B[32m", "", "\x1B[31m"};
+
+    printf("\t%-24s wall [%9.2f \xC2\xB1%-7.2f ms] user [%9.2f ms] sys [%8.2f ms] rss [%7.0f KB]",
+           name, wall->median, (wall->hi - wall->lo) / 2, preload_median(st->user),
+           preload_median(st->sys), preload_median(st->rss));
+    if (wall != ref) {
+        printf(" %s%6.2fx\e[0m", colors[measure_compare(wall, ref) + 1], ref->median / wall->median);
+    }
+    printf("\n");
+}
+
+// Returns the number of libraries changing the output or the exit status of the command
+int run_preload(int ac, char **av)
+{
+    static struct preload_stats stats[MAX_LIBRARIES + 1];
+    struct measurement walls[MAX_LIBRARIES + 1];
+    char *paths[MAX_LIBRARIES + 1] = {NULL};
+    int differing = 0;
+
+    if (ac == 0) {
+        printf("No command to run, give it after the options: ./tests --preload -- sort file\n");
+        exit(1);
+    }
+    for (int i = 0; i < nb_libraries; i++) {
+        if ((paths[i + 1] = realpath(libraries[i].path, NULL)) == NULL) {
+            option_error("lib", libraries[i].path, strerror(errno));
+        }
+    }
+    printf("|------------| Running command: [");
+    for (int i = 0; i < ac; i++) {
+        printf(i ? " %s" : "%s", av[i]);
+    }
+    printf("] |------------|\n\n");
+    printf("--> %d runs of each variant after a warm up, times are medians\n\n", preload_runs);
+    for (int run = 0; run <= preload_runs; run++) {
+        for (int v = 0; v <= nb_libraries; v++) {
+            preload_run(av, paths[v], &stats[v], run);
+        }
+    }
+    for (int v = 0; v <= nb_libraries; v++) {
+        memset(&walls[v], 0, sizeof(walls[v]));
+        bootstrap_median(stats[v].wall + 1, preload_runs, &walls[v].lo, &walls[v].hi);
+        walls[v].median = preload_median(stats[v].wall);
+        print_preload_row(v ? libraries[v - 1].path : "glibc", &stats[v], &walls[v], &walls[0]);
+    }
+    printf("\n");
+    if (WIFSIGNALED(stats[0].status)) {
+        printf("\x1B[33m--> The command is killed by signal %d without any library\n\e[0m",
+               WTERMSIG(stats[0].status));
+    } else if (WEXITSTATUS(stats[0].status) != 0) {
+        printf("\x1B[33m--> The command fails without any library (status %d)\n\e[0m",
+               WEXITSTATUS(stats[0].status));
+    }
+    for (int v = 0; v <= nb_libraries; v++) {
+        const char *name = v ? libraries[v - 1].path : "glibc";
+        if (stats[v].unstable) {
+            printf("\x1B[33m--> [%s] changed output or exit status between runs\n\e[0m", name);
+        }
+        if (v > 0 && (stats[v].output != stats[0].output || stats[v].status != stats[0].status)) {
+            printf("\x1B[31m--> [%s] gives a different output or exit status than glibc\n\e[0m", name);
+            differing++;
+        }
+        free(paths[v]);
+    }
+    return differing;
+}
+
+/*
+
+Trace replay
+Map a trace recorded by TraceShim.so, rebuild the arguments of its calls (lengths, alignments,
+positions of the match or of the first difference) and time the library and glibc on that exact mix
+
+*/
+
+#define REPLAY_MAX_BYTES ((size_t)256 << 20)
+
+char *replay_path = NULL;
+size_t replay_max = 100000;
+
+struct replay_call {
+    char *s1;
+    char *s2;
+    size_t n;
+    int c;
+};
+
+struct replay {
+    struct replay_call *calls;
+    size_t nb;
+    size_t bytes;
+    char *pool;
+    size_t pool_size;
+    size_t pool_used;
+};
+
+struct replay_fn {
+    char *funcname;
+    int func;
+    void **sym;
+    void *libc;
+    measure_loop_t loop;
+};
+
+#define REPLAY_LOOP(name, call) \
+    static void replay_loop_##name(void *fn, void *arg, size_t iters) \
+    { \
+        __typeof__(my_##name) f = fn; \
+        const struct replay *r = arg; \
+        for (size_t i = 0; i < iters; i++) { \
+            for (const struct replay_call *k = r->calls; k < r->calls + r->nb; k++) { \
+                call; \
+            } \
+        } \
+    }
+
+REPLAY_LOOP(strlen, f(k->s1))
+REPLAY_LOOP(strchr, f(k->s1, k->c))
+REPLAY_LOOP(strrchr, f(k->s1, k->c))
+REPLAY_LOOP(memset, f(k->s1, k->c, k->n))
+REPLAY_LOOP(memcpy, f(k->s1, k->s2, k->n))
+REPLAY_LOOP(strcmp, f(k->s1, k->s2))
+REPLAY_LOOP(memmove, f(k->s1, k->s2, k->n))
+REPLAY_LOOP(strncmp, f(k->s1, k->s2, k->n))
+REPLAY_LOOP(strcasecmp, f(k->s1, k->s2))
+REPLAY_LOOP(strstr, f(k->s1, k->s2))
+REPLAY_LOOP(strpbrk, f(k->s1, k->s2))
+REPLAY_LOOP(strcspn, f(k->s1, k->s2))
+
+#define REPLAY(name, func) {#name, func, (void **)&my_##name, (void *)name, replay_loop_##name}
+
+static const struct replay_fn REPLAYS[] = {
+    REPLAY(strlen, TRACE_STRLEN),
+    REPLAY(strchr, TRACE_STRCHR),
+    REPLAY(strrchr, TRACE_STRRCHR),
+    REPLAY(memset, TRACE_MEMSET),
+    REPLAY(memcpy, TRACE_MEMCPY),
+    REPLAY(strcmp, TRACE_STRCMP),
+    REPLAY(memmove, TRACE_MEMMOVE),
+    REPLAY(strncmp, TRACE_STRNCMP),
+    REPLAY(strcasecmp, TRACE_STRCASECMP),
+    REPLAY(strstr, TRACE_STRSTR),
+    REPLAY(strpbrk, TRACE_STRPBRK),
+    REPLAY(strcspn, TRACE_STRCSPN),
+};
+
+#define NB_REPLAYS (sizeof(REPLAYS) / sizeof(REPLAYS[0]))
+
+// Bytes of the pool used by the arguments of a call
+static size_t replay_footprint(const struct trace_record *t)
+{
+    size_t second = t->len2;
+
+    if (t->func == TRACE_MEMMOVE && t->result != TRACE_NONE) {
+        second = labs((int32_t)t->result);
+    } else if (t->func == TRACE_MEMCPY || t->func == TRACE_MEMMOVE) {
+        second = t->len1;
+    }
+    return (size_t)t->len1 + second + 2 + 2 * 128;
+}
+
+// Buffer starting align bytes after a cache line
+static char *replay_take(struct replay *r, size_t size, int align)
+{
+    size_t start = (r->pool_used + 63) / 64 * 64 + align;
+
+    assert(start + size <= r->pool_size);
+    r->pool_used = start + size;
+    return r->pool + start;
+}
+
+// Lowercase letters, none of them equal to avoid
+static void replay_letters(char *s, size_t len, int avoid, char base)
+{
+    for (size_t i = 0; i < len; i++) {
+        s[i] = base + (i * 7) % 26;
+        if ((unsigned char)s[i] == avoid) {
+            s[i] = base + (i * 7 + 1) % 26;
+        }
+    }
+    s[len] = '\0';
+}
+
+static void replay_build(struct replay *r, const struct trace_record *t)
+{
+    struct replay_call *k = &r->calls[r->nb++];
+    size_t prefix = t->result;
+
+    memset(k, 0, sizeof(*k));
+    switch (t->func) {
+    case TRACE_STRLEN:
+        k->s1 = replay_take(r, t->len1 + 1, t->align1);
+        replay_letters(k->s1, t->len1, 0, 'a');
+        break;
+    case TRACE_STRCHR:
+    case TRACE_STRRCHR:
+        k->c = t->c;
+        k->s1 = replay_take(r, t->len1 + 1, t->align1);
+        replay_letters(k->s1, t->len1, t->c, 'a');
+        if (t->result < t->len1) {
+            k->s1[t->result] = t->c;
+        }
+        break;
+    case TRACE_MEMSET:
+        k->c = t->c;
+        k->n = t->len1;
+        k->s1 = replay_take(r, t->len1, t->align1);
+        break;
+    case TRACE_MEMMOVE:
+        if (t->result != TRACE_NONE) {
+            ptrdiff_t distance = (int32_t)t->result;
+            k->n = t->len1;
+            k->s2 = replay_take(r, t->len1 + labs(distance), t->align2);
+            if (distance < 0) {
+                k->s2 -= distance;
+            }
+            k->s1 = k->s2 + distance;
+            break;
+        }
+        // fallthrough
+    case TRACE_MEMCPY:
+        k->n = t->len1;
+        k->s1 = replay_take(r, t->len1, t->align1);
+        k->s2 = replay_take(r, t->len1, t->align2);
+        memset(k->s2, 'a', t->len1);
+        break;
+    case TRACE_STRNCMP:
+    case TRACE_STRCMP:
+    case TRACE_STRCASECMP:
+        k->n = t->n;
+        k->s1 = replay_take(r, t->len1 + 1, t->align1);
+        k->s2 = replay_take(r, t->len2 + 1, t->align2);
+        replay_letters(k->s1, t->len1, 0, 'a');
+        replay_letters(k->s2, t->len2, 0, t->func == TRACE_STRCASECMP ? 'A' : 'a');
+        // s2 differs from s1 right after the recorded common prefix
+        if (prefix < t->len1 && prefix < t->len2) {
+            k->s2[prefix] = k->s1[prefix] == 'z' ? 'y' : 'z';
+        }
+        break;
+    case TRACE_STRSTR:
+        k->s1 = replay_take(r, t->len1 + 1, t->align1);
+        k->s2 = replay_take(r, t->len2 + 1, t->align2);
+        replay_letters(k->s1, t->len1, 0, 'a');
+        replay_letters(k->s2, t->len2, 0, 'A');
+        if (t->result != TRACE_NONE && t->result + t->len2 <= t->len1) {
+            memcpy(k->s1 + t->result, k->s2, t->len2);
+        }
+        break;
+    case TRACE_STRPBRK:
+    case TRACE_STRCSPN:
+        k->s1 = replay_take(r, t->len1 + 1, t->align1);
+        k->s2 = replay_take(r, t->len2 + 1, t->align2);
+        replay_letters(k->s1, t->len1, 0, 'a');
+        for (size_t i = 0; i < t->len2; i++) {
+            k->s2[i] = 0x80 | (i % 128);
+        }
+        k->s2[t->len2] = '\0';
+        if (t->result < t->len1 && t->len2 > 0) {
+            k->s1[t->result] = k->s2[0];
+        }
+        break;
+    }
+}
+
+// The destination must hold what the source held before the call, even when they overlap
+static int replay_same_copy(void *fn, const struct replay_call *k, char *expected)
+{
+    void *(*copy)(void *, const void *, size_t) = fn;
+
+    for (size_t i = 0; i < k->n; i++) {
+        k->s2[i] = (char)(i * 131 + 7);
+    }
+    memcpy(expected, k->s2, k->n);
+    return copy(k->s1, k->s2, k->n) == k->s1 && memcmp(k->s1, expected, k->n) == 0;
+}
+
+static int replay_same_memset(const struct replay_call *k)
+{
+    memset(k->s1, ~k->c, k->n);
+    if (my_memset(k->s1, k->c, k->n) != k->s1) {
+        return 0;
+    }
+    for (size_t i = 0; i < k->n; i++) {
+        if (k->s1[i] != (char)k->c) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Calls whose result differs from glibc, or that leave the wrong bytes in the destination
+static size_t replay_check(const struct replay_fn *rf, const struct replay *r)
+{
+    size_t mismatches = 0;
+    size_t longest = 0;
+    char *expected;
+
+    for (const struct replay_call *k = r->calls; k < r->calls + r->nb; k++) {
+        longest = k->n > longest ? k->n : longest;
+    }
+    NOT_NULL(expected = malloc(longest + 1));
+    for (const struct replay_call *k = r->calls; k < r->calls + r->nb; k++) {
+        int same = 1;
+        switch (rf->func) {
+        case TRACE_MEMSET:
+            same = replay_same_memset(k);
+            break;
+        case TRACE_MEMCPY:
+            same = replay_same_copy((void *)my_memcpy, k, expected);
+            break;
+        case TRACE_MEMMOVE:
+            same = replay_same_copy((void *)my_memmove, k, expected);
+            break;
+        case TRACE_STRLEN:
+            same = my_strlen(k->s1) == strlen(k->s1);
+            break;
+        case TRACE_STRCHR:
+            same = my_strchr(k->s1, k->c) == strchr(k->s1, k->c);
+            break;
+        case TRACE_STRRCHR:
+            same = my_strrchr(k->s1, k->c) == strrchr(k->s1, k->c);
+            break;
+        case TRACE_STRCMP:
+            same = same_strcmp(my_strcmp(k->s1, k->s2), k->s1, k->s2);
+            break;
+        case TRACE_STRNCMP:
+            same = same_strncmp(my_strncmp(k->s1, k->s2, k->n), k->s1, k->s2, k->n);
+            break;
+        case TRACE_STRCASECMP:
+            same = same_strcasecmp(my_strcasecmp(k->s1, k->s2), k->s1, k->s2);
+            break;
+        case TRACE_STRSTR:
+            same = my_strstr(k->s1, k->s2) == strstr(k->s1, k->s2);
+            break;
+        case TRACE_STRPBRK:
+            same = my_strpbrk(k->s1, k->s2) == strpbrk(k->s1, k->s2);
+            break;
+        case TRACE_STRCSPN:
+            same = my_strcspn(k->s1, k->s2) == strcspn(k->s1, k->s2);
+            break;
+        }
+        mismatches += !same;
+    }
+    free(expected);
+    return mismatches;
+}
+
+void run_replay(const struct replay_fn *rf, const struct trace_record *records, size_t nb_records)
+{
+    struct replay r = {NULL, 0, 0, NULL, 0, 0};
+    struct measurement mine;
+    struct measurement libc;
+    size_t recorded = 0;
+    size_t bytes = 0;
+
+    printf("|------------| Replaying trace for: [%s] |------------|\n\n", rf->funcname);
+    if (*rf->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    for (size_t i = 0; i < nb_records; i++) {
+        if (records[i].func == rf->func) {
+            recorded++;
+            bytes += replay_footprint(&records[i]);
+        }
+    }
+    if (recorded == 0) {
+        printf("\tNo call recorded\n\n");
+        return;
+    }
+    // Keep one call out of stride when the trace is too big to rebuild
+    size_t stride = (recorded + replay_max - 1) / replay_max;
+    if (bytes / stride > REPLAY_MAX_BYTES) {
+        stride = (bytes + REPLAY_MAX_BYTES - 1) / REPLAY_MAX_BYTES;
+    }
+    for (size_t i = 0, seen = 0; i < nb_records; i++) {
+        if (records[i].func == rf->func && seen++ % stride == 0) {
+            r.pool_size += replay_footprint(&records[i]);
+            r.nb++;
+        }
+    }
+    NOT_NULL(r.calls = malloc(sizeof(*r.calls) * r.nb));
+    NOT_NULL(r.pool = aligned_alloc(64, (r.pool_size + 63) / 64 * 64));
+    r.nb = 0;
+    for (size_t i = 0, seen = 0; i < nb_records; i++) {
+        if (records[i].func == rf->func && seen++ % stride == 0) {
+            r.bytes += (size_t)records[i].len1 + records[i].len2;
+            replay_build(&r, &records[i]);
+        }
+    }
+    size_t mismatches = replay_check(rf, &r);
+    measure(rf->loop, *rf->sym, &r, &mine);
+    measure(rf->loop, rf->libc, &r, &libc);
+    printf("\tCalls:      [%lu replayed of %lu recorded]\n", r.nb, recorded);
+    printf("\tMismatches: [%s%lu\e[0m]\n", mismatches ? "\x1B[31m" : "\x1B[32m", mismatches);
+    printf("\tLibrary:    [%.2f ns/call, %.2f GB/s]\n", mine.median / r.nb, r.bytes / mine.median);
+    printf("\tglibc:      [%.2f ns/call, %.2f GB/s]\n", libc.median / r.nb, r.bytes / libc.median);
+    char *colors[] = {"\x1B[32m", "", "\x1B[31m"};
+    printf("\tSpeedup:    [%s%.2fx\e[0m]\n\n", colors[measure_compare(&mine, &libc) + 1],
+           libc.median / mine.median);
+    if (mismatches) {
+        failure++;
+    } else {
+        success++;
+    }
+    free(r.calls);
+    free(r.pool);
+}
+
+void run_replays(int ac, char **av)
+{
+    struct trace_header header;
+    struct stat st;
+    int fd = open(replay_path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        printf("\x1B[31m--> Could not open trace [%s]: %s\n\e[0m", replay_path, strerror(errno));
+        exit(1);
+    }
+    if (read(fd, &header, sizeof(header)) != sizeof(header)
+        || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != TRACE_VERSION || header.record_size != sizeof(struct trace_record)) {
+        printf("\x1B[31m--> [%s] is not a version %d trace\n\e[0m", replay_path, TRACE_VERSION);
+        exit(1);
+    }
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    assert(map != MAP_FAILED);
+    size_t nb_records = (st.st_size - sizeof(header)) / sizeof(struct trace_record);
+    printf("--> Replaying %lu calls from trace [%s]\n\n", nb_records, replay_path);
+    measure_pin();
+    for (unsigned int i = 0; i < NB_REPLAYS; i++) {
+        if (is_selected(REPLAYS[i].funcname, ac, av)) {
+            run_replay(&REPLAYS[i], (const struct trace_record *)(map + sizeof(header)),
+                       nb_records);
+        }
+    }
+    munmap(map, st.st_size);
+}
+
+/*
+
+ABI check
+Each function is called through an assembly trampoline that loads sentinels in the callee-saved
+registers, guards the caller frame above the return address and records the state on return:
+registers, stack pointer, direction flag, MXCSR, x87 control word and, with XGETBV(ECX=1),
+whether the upper halves of the YMM/ZMM registers were left dirty.
+A legacy SSE loop is then timed after the call, with and without a vzeroupper in between
+
+*/
+
+#define ABI_CANARY 0xA5A5A5A5A5A5A5A5UL
+#define ABI_MAX_SIZE 4096
+#define ABI_SSE_SIZE 256
+#define ABI_MAX_SLOWDOWN 1.10
+#define ABI_VZEROUPPER 1
+#define ABI_XGETBV1 2
+// XINUSE bits of the upper halves of YMM0-15 and ZMM0-15
+#define ABI_UPPER_STATE ((1UL << 2) | (1UL << 6))
+
+struct abi_state {
+    uint64_t regs[6];
+    uint64_t rsp_delta;
+    uint64_t flags;
+    uint32_t mxcsr;
+    uint16_t fpucw;
+    uint16_t pad;
+    uint64_t xinuse;
+    uint64_t frame_changes;
+    uint64_t ret;
+    uint64_t features;
+};
+
+static const char *ABI_REGS[] = {"rbx", "rbp", "r12", "r13", "r14", "r15"};
+
+uint64_t abi_rsp_before = 0;
+uint64_t abi_rsp_after = 0;
+int abi_mode = 0;
+
+void abi_trampoline(void *fn, const uint64_t *args, struct abi_state *state);
+
+__asm__(
+    ".text\n"
+    ".globl abi_trampoline\n"
+    ".type abi_trampoline, @function\n"
+    "abi_trampoline:\n"
+    "    push %rbp\n"
+    "    push %rbx\n"
+    "    push %r12\n"
+    "    push %r13\n"
+    "    push %r14\n"
+    "    push %r15\n"
+    // 128 bytes of caller frame, then the state and the function
+    "    sub $152, %rsp\n"
+    "    mov %rdx, 128(%rsp)\n"
+    "    mov %rdi, 136(%rsp)\n"
+    "    movabs $0xA5A5A5A5A5A5A5A5, %rax\n"
+    "    xor %ecx, %ecx\n"
+    "1:  mov %rax, (%rsp,%rcx,8)\n"
+    "    inc %ecx\n"
+    "    cmp $16, %ecx\n"
+    "    jne 1b\n"
+    "    testq $1, 96(%rdx)\n"
+    "    jz 2f\n"
+    "    vzeroupper\n"
+    "2:  mov 16(%rsi), %rdx\n"
+    "    mov 0(%rsi), %rdi\n"
+    "    mov 8(%rsi), %rsi\n"
+    "    movabs $0x1111111111111111, %rbx\n"
+    "    movabs $0x2222222222222222, %rbp\n"
+    "    movabs $0x3333333333333333, %r12\n"
+    "    movabs $0x4444444444444444, %r13\n"
+    "    movabs $0x5555555555555555, %r14\n"
+    "    movabs $0x6666666666666666, %r15\n"
+    "    mov %rsp, abi_rsp_before(%rip)\n"
+    "    call *136(%rsp)\n"
+    "    mov %rsp, abi_rsp_after(%rip)\n"
+    "    mov abi_rsp_before(%rip), %rsp\n"
+    "    pushfq\n"
+    "    pop %rcx\n"
+    "    cld\n"
+    "    mov 128(%rsp), %r11\n"
+    "    mov %rax, 88(%r11)\n"
+    "    mov %rcx, 56(%r11)\n"
+    "    mov %rbx, 0(%r11)\n"
+    "    mov %rbp, 8(%r11)\n"
+    "    mov %r12, 16(%r11)\n"
+    "    mov %r13, 24(%r11)\n"
+    "    mov %r14, 32(%r11)\n"
+    "    mov %r15, 40(%r11)\n"
+    "    stmxcsr 64(%r11)\n"
+    "    fnstcw 68(%r11)\n"
+    "    testq $2, 96(%r11)\n"
+    "    jz 3f\n"
+    "    mov $1, %ecx\n"
+    "    xgetbv\n"
+    "    shl $32, %rdx\n"
+    "    or %rdx, %rax\n"
+    "    mov %rax, 72(%r11)\n"
+    "3:  mov abi_rsp_after(%rip), %rax\n"
+    "    sub %rsp, %rax\n"
+    "    mov %rax, 48(%r11)\n"
+    "    xor %eax, %eax\n"
+    "    xor %ecx, %ecx\n"
+    "    movabs $0xA5A5A5A5A5A5A5A5, %rdx\n"
+    "4:  cmp %rdx, (%rsp,%rcx,8)\n"
+    "    je 5f\n"
+    "    inc %rax\n"
+    "5:  inc %ecx\n"
+    "    cmp $16, %ecx\n"
+    "    jne 4b\n"
+    "    mov %rax, 80(%r11)\n"
+    "    add $152, %rsp\n"
+    "    pop %r15\n"
+    "    pop %r14\n"
+    "    pop %r13\n"
+    "    pop %r12\n"
+    "    pop %rbx\n"
+    "    pop %rbp\n"
+    "    ret\n"
+    ".size abi_trampoline, .-abi_trampoline\n"
+);
+
+// vzeroupper needs AVX, XGETBV with ECX=1 the XINUSE support of XSAVE
+static uint64_t abi_features(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    uint64_t features = 0;
+
+    __cpuid(1, eax, ebx, ecx, edx);
+    if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) {
+        return 0;
+    }
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    if ((eax & 6) != 6) {
+        return 0;
+    }
+    features |= ABI_VZEROUPPER;
+    __cpuid_count(0xD, 1, eax, ebx, ecx, edx);
+    if (eax & (1 << 2)) {
+        features |= ABI_XGETBV1;
+    }
+    return features;
+}
+
+// Arguments of the call, in order: '1' s1, '2' s2, 'n' n, 'c' c
+struct abi_fn {
+    char *funcname;
+    char *args;
+};
+
+static const struct abi_fn ABIS[] = {
+    {"strlen", "1"},
+    {"strchr", "1c"},
+    {"strrchr", "1c"},
+    {"memset", "1cn"},
+    {"memcpy", "12n"},
+    {"strcmp", "12"},
+    {"memmove", "12n"},
+    {"strncmp", "12n"},
+    {"strcasecmp", "12"},
+    {"strstr", "12"},
+    {"strpbrk", "12"},
+    {"strcspn", "12"},
+    {"ffs", "c"},
+    {"memfrob", "1n"},
+    {"strfry", "1"},
+};
+
+#define NB_ABIS (sizeof(ABIS) / sizeof(ABIS[0]))
+
+static void abi_args(const char *args, const struct bench_ctx *ctx, uint64_t *out)
+{
+    for (int i = 0; args[i] != '\0'; i++) {
+        switch (args[i]) {
+        case '1':
+            out[i] = (uint64_t)ctx->s1;
+            break;
+        case '2':
+            out[i] = (uint64_t)ctx->s2;
+            break;
+        case 'n':
+            out[i] = ctx->n;
+            break;
+        case 'c':
+            out[i] = ctx->c;
+            break;
+        }
+    }
+}
+
+// Number of ABI violations in the state left by a call, each of them printed
+static int abi_problems(const struct abi_state *st, uint32_t mxcsr, uint16_t fpucw, size_t size)
+{
+    static const uint64_t sentinels[] = {
+        0x1111111111111111, 0x2222222222222222, 0x3333333333333333,
+        0x4444444444444444, 0x5555555555555555, 0x6666666666666666,
+    };
+    int problems = 0;
+
+    for (int i = 0; i < 6; i++) {
+        if (st->regs[i] != sentinels[i]) {
+            printf("\tRegister:     [\x1B[31m%s clobbered at size %lu\e[0m]\n", ABI_REGS[i], size);
+            problems++;
+        }
+    }
+    if (st->rsp_delta != 0) {
+        printf("\tStack:        [\x1B[31mrsp moved by %ld at size %lu\e[0m]\n",
+               (long)st->rsp_delta, size);
+        problems++;
+    }
+    if (st->frame_changes != 0) {
+        printf("\tCaller frame: [\x1B[31m%lu words above the return address written "
+               "at size %lu\e[0m]\n", st->frame_changes, size);
+        problems++;
+    }
+    if (st->flags & (1 << 10)) {
+        printf("\tDirection:    [\x1B[31mDF left set at size %lu\e[0m]\n", size);
+        problems++;
+    }
+    if ((st->mxcsr & ~0x3FU) != (mxcsr & ~0x3FU) || st->fpucw != fpucw) {
+        printf("\tFP control:   [\x1B[31mMXCSR %#x x87 %#x instead of %#x %#x at size %lu\e[0m]\n",
+               st->mxcsr, st->fpucw, mxcsr, fpucw, size);
+        problems++;
+    }
+    return problems;
+}
+
+// Legacy SSE moves merge the dirty upper halves of YMM registers, chaining independent operations
+static inline void abi_sse_loop(void)
+{
+    for (int i = 0; i < 16; i++) {
+        __asm__ volatile(
+            "movaps %%xmm1, %%xmm2\n"
+            "addps %%xmm2, %%xmm2\n"
+            "movaps %%xmm1, %%xmm3\n"
+            "addps %%xmm3, %%xmm3\n"
+            "movaps %%xmm1, %%xmm4\n"
+            "addps %%xmm4, %%xmm4\n"
+            "movaps %%xmm1, %%xmm5\n"
+            "addps %%xmm5, %%xmm5\n"
+            ::: "xmm2", "xmm3", "xmm4", "xmm5");
+    }
+}
+
+struct abi_sse_arg {
+    const struct bench *b;
+    struct bench_ctx *ctx;
+};
+
+static void abi_loop_dirty(void *fn, void *arg, size_t iters)
+{
+    struct abi_sse_arg *a = arg;
+
+    for (size_t i = 0; i < iters; i++) {
+        a->b->loop(fn, a->ctx, 1);
+        abi_sse_loop();
+    }
+}
+
+static void abi_loop_clean(void *fn, void *arg, size_t iters)
+{
+    struct abi_sse_arg *a = arg;
+
+    for (size_t i = 0; i < iters; i++) {
+        a->b->loop(fn, a->ctx, 1);
+        __asm__ volatile("vzeroupper");
+        abi_sse_loop();
+    }
+}
+
+void run_abi(const struct abi_fn *af, char *buf1, char *buf2, uint64_t features)
+{
+    static const size_t sizes[] = {
+        0, 1, 7, 16, 31, 32, 33, 63, 64, 100, 255, 256, 1000, ABI_MAX_SIZE
+    };
+    const struct bench *b = find_bench(af->funcname);
+    struct bench_ctx ctx = {buf1, buf2, 0, 0, 0};
+    int problems = 0;
+    int dirty = 0;
+    size_t dirty_size = 0;
+
+    printf("|------------| Running ABI check for: [%s] |------------|\n\n", af->funcname);
+    if (*b->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && problems == 0; i++) {
+        struct abi_state st = {{0}, 0, 0, 0, 0, 0, 0, 0, 0, features};
+        uint64_t args[3] = {0, 0, 0};
+        uint32_t mxcsr = _mm_getcsr();
+        uint16_t fpucw;
+        __asm__ volatile("fnstcw %0" : "=m"(fpucw));
+        b->prepare(&ctx, sizes[i]);
+        abi_args(af->args, &ctx, args);
+        abi_trampoline(*b->sym, args, &st);
+        problems += abi_problems(&st, mxcsr, fpucw, sizes[i]);
+        if ((features & ABI_XGETBV1) && (st.xinuse & ABI_UPPER_STATE) && !dirty) {
+            dirty_size = sizes[i];
+            dirty = 1;
+        }
+        _mm_setcsr(mxcsr);
+        __asm__ volatile("fldcw %0" :: "m"(fpucw));
+        if (!b->sized) {
+            break;
+        }
+    }
+    if (problems == 0) {
+        printf("\tState:        [\x1B[32mpreserved\e[0m]\n");
+    }
+    if (!(features & ABI_XGETBV1)) {
+        printf("\tUpper state:  [n/a, no XGETBV with ECX=1]\n");
+    } else if (dirty) {
+        printf("\tUpper state:  [\x1B[31mdirty at size %lu, missing vzeroupper\e[0m]\n",
+               dirty_size);
+    } else {
+        printf("\tUpper state:  [\x1B[32mclean\e[0m]\n");
+    }
+    // A function breaking the ABI cannot be called outside of the trampoline
+    if ((features & ABI_VZEROUPPER) && problems == 0) {
+        struct abi_sse_arg arg = {b, &ctx};
+        struct measurement dirty_time;
+        struct measurement clean;
+        b->prepare(&ctx, b->sized ? ABI_SSE_SIZE : 0);
+        measure(abi_loop_dirty, *b->sym, &arg, &dirty_time);
+        measure(abi_loop_clean, *b->sym, &arg, &clean);
+        double slowdown = dirty_time.median / clean.median;
+        int slower = slowdown > ABI_MAX_SLOWDOWN && measure_compare(&dirty_time, &clean) > 0;
+        printf("\tSSE after:    [%s%.2fx\e[0m slower than after a vzeroupper]\n",
+               slower ? "\x1B[31m" : "\x1B[32m", slowdown);
+        problems += slower;
+    }
+    printf("\n");
+    if (problems || dirty) {
+        failure++;
+    } else {
+        success++;
+    }
+}
+
+void run_abis(int ac, char **av)
+{
+    uint64_t features = abi_features();
+    char *buf1;
+    char *buf2;
+
+    measure_pin();
+    NOT_NULL(buf1 = aligned_alloc(64, ABI_MAX_SIZE + 64));
+    NOT_NULL(buf2 = aligned_alloc(64, ABI_MAX_SIZE + 64));
+    for (unsigned int i = 0; i < NB_ABIS; i++) {
+        if (is_selected(ABIS[i].funcname, ac, av)) {
+            run_abi(&ABIS[i], buf1, buf2, features);
+        }
+    }
+    free(buf1);
+    free(buf2);
+}
+
+/*
+
+Sampling profiler
+Drive a function in a loop while a SIGPROF timer samples the instruction pointer,
+then map every sample back to a symbol and an offset with dladdr.
+The instructions of the function are listed with their share of the samples
+(disassembled by objdump when it is installed), and the samples can be saved as folded stacks
+
+*/
+
+#define PROFILE_MAX_SAMPLES (1 << 20)
+#define PROFILE_INTERVAL_US 100
+#define PROFILE_MAX_INSNS 4096
+
+int profile_ms = 0;
+size_t profile_size = 4096;
+char *profile_folded_path = NULL;
+uintptr_t *profile_samples = NULL;
+volatile size_t profile_nb = 0;
+
+struct profile_insn {
+    uintptr_t addr;
+    char text[80];
+};
+
+static void profile_signal(int signum, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = context;
+
+    (void)signum;
+    (void)info;
+    if (profile_nb < PROFILE_MAX_SAMPLES) {
+        profile_samples[profile_nb++] = uc->uc_mcontext.gregs[REG_RIP];
+    }
+}
+
+static int compare_addresses(const void *a, const void *b)
+{
+    uintptr_t x = *(const uintptr_t *)a;
+    uintptr_t y = *(const uintptr_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Instructions of [start, start + size) in the file, as addresses relative to its base
+static size_t profile_disassemble(const char *path, uintptr_t start, size_t size,
+                                  struct profile_insn *insns)
+{
+    char command[PATH_MAX + 128];
+    char line[256];
+    size_t nb = 0;
+
+    snprintf(command, sizeof(command), "objdump -d --no-show-raw-insn --start-address=%#lx "
+             "--stop-address=%#lx '%s' 2>/dev/null", start, start + size, path);
+    FILE *objdump = popen(command, "r");
+    if (objdump == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), objdump) != NULL && nb < PROFILE_MAX_INSNS) {
+        char *end;
+        uintptr_t addr = strtoul(line, &end, 16);
+        if (end == line || *end != ':' || end[1] != '\t') {
+            continue;
+        }
+        insns[nb].addr = addr;
+        snprintf(insns[nb].text, sizeof(insns[nb].text), "%s", end + 2);
+        insns[nb].text[strcspn(insns[nb].text, "\n")] = '\0';
+        nb++;
+    }
+    pclose(objdump);
+    return nb;
+}
+
+static size_t profile_count(const uintptr_t *sorted, size_t nb, uintptr_t addr)
+{
+    size_t lo = 0;
+    size_t hi = nb;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (sorted[mid] < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t count = 0;
+    while (lo + count < nb && sorted[lo + count] == addr) {
+        count++;
+    }
+    return count;
+}
+
+static void print_profile_row(const char *label, size_t count, size_t total, size_t max,
+                              const char *text)
+{
+    char bar[41] = {0};
+    double share = total ? 100.0 * count / total : 0;
+
+    memset(bar, '#', max ? count * 40 / max : 0);
+    printf("\t%-22s %8lu %6.2f%% %-40s %s\n", label, count, share, bar, text);
+}
+
+// One folded stack per sampled address: driver;symbol;symbol+offset count
+static void profile_fold(FILE *folded, const char *funcname, const uintptr_t *sorted, size_t nb)
+{
+    for (size_t i = 0; i < nb;) {
+        size_t count = profile_count(sorted, nb, sorted[i]);
+        Dl_info info;
+        if (dladdr((void *)sorted[i], &info) && info.dli_sname != NULL) {
+            fprintf(folded, "profile_%s;%s;%s+0x%lx %lu\n", funcname, info.dli_sname,
+                    info.dli_sname, sorted[i] - (uintptr_t)info.dli_saddr, count);
+        } else {
+            const char *file = info.dli_fname ? strrchr(info.dli_fname, '/') : NULL;
+            fprintf(folded, "profile_%s;[%s] %lu\n", funcname,
+                    file ? file + 1 : (info.dli_fname ? info.dli_fname : "unknown"), count);
+        }
+        i += count;
+    }
+}
+
+void run_profile(const struct bench *b, struct bench_ctx *ctx, FILE *folded)
+{
+    static struct profile_insn insns[PROFILE_MAX_INSNS];
+    struct itimerval timer = {{0, PROFILE_INTERVAL_US}, {0, PROFILE_INTERVAL_US}};
+    struct itimerval stop = {{0, 0}, {0, 0}};
+    const ElfW(Sym) *sym = NULL;
+    Dl_info info;
+
+    printf("|------------| Profiling: [%s] |------------|\n\n", b->funcname);
+    if (*b->sym == NULL) {
+        printf("\x1B[31mSymbol not loaded, skipping\n\n\e[0m");
+        return;
+    }
+    if (!dladdr1(*b->sym, &info, (void **)&sym, RTLD_DL_SYMENT) || sym == NULL) {
+        printf("\x1B[31mSymbol not found by dladdr, skipping\n\n\e[0m");
+        return;
+    }
+    // Assembled symbols often have no ELF size: measure it like the fingerprints do
+    size_t size = 0;
+    for (unsigned int i = 0; i < NB_SYMBOLS; i++) {
+        if (SYMBOLS[i].sym == b->sym) {
+            size = symbol_code_size(&libraries[current_library], i);
+        }
+    }
+    if (size == 0) {
+        printf("\x1B[31mSize unknown for [%s], skipping\n\n\e[0m", info.dli_sname);
+        return;
+    }
+    uintptr_t start = (uintptr_t)info.dli_saddr;
+    uintptr_t end = start + size;
+    b->prepare(ctx, b->sized ? profile_size : 0);
+    profile_nb = 0;
+    setitimer(ITIMER_PROF, &timer, NULL);
+    for (uint64_t t = measure_now_ns(); measure_now_ns() - t < (uint64_t)profile_ms * 1000000;) {
+        b->loop(*b->sym, ctx, 1000);
+    }
+    setitimer(ITIMER_PROF, &stop, NULL);
+
+    size_t nb = profile_nb;
+    size_t inside = 0;
+    size_t max = 0;
+    qsort(profile_samples, nb, sizeof(*profile_samples), compare_addresses);
+    for (size_t i = 0; i < nb; i++) {
+        inside += profile_samples[i] >= start && profile_samples[i] < end;
+    }
+    for (size_t i = 0; i < nb;) {
+        size_t count = profile_count(profile_samples, nb, profile_samples[i]);
+        if (profile_samples[i] >= start && profile_samples[i] < end && count > max) {
+            max = count;
+        }
+        i += count;
+    }
+    printf("\tSamples:     [%lu, %.1f%% in %s, %lu bytes at %s+%#lx]\n\n", nb,
+           nb ? 100.0 * inside / nb : 0, info.dli_sname, size,
+           info.dli_fname, start - (uintptr_t)info.dli_fbase);
+    size_t nb_insns = profile_disassemble(info.dli_fname, start - (uintptr_t)info.dli_fbase,
+                                          size, insns);
+    if (nb_insns > 0) {
+        for (size_t i = 0; i < nb_insns; i++) {
+            char label[64];
+            uintptr_t addr = insns[i].addr + (uintptr_t)info.dli_fbase;
+            snprintf(label, sizeof(label), "%s+0x%lx", info.dli_sname, addr - start);
+            print_profile_row(label, profile_count(profile_samples, nb, addr), nb, max,
+                              insns[i].text);
+        }
+    } else {
+        // No objdump: only the sampled addresses
+        for (size_t i = 0; i < nb;) {
+            size_t count = profile_count(profile_samples, nb, profile_samples[i]);
+            if (profile_samples[i] >= start && profile_samples[i] < end) {
+                char label[64];
+                snprintf(label, sizeof(label), "%s+0x%lx", info.dli_sname,
+                         profile_samples[i] - start);
+                print_profile_row(label, count, nb, max, "");
+            }
+            i += count;
+        }
+    }
+    printf("\n");
+    if (folded != NULL) {
+        profile_fold(folded, b->funcname, profile_samples, nb);
+    }
+}
+
+void run_profiles(int ac, char **av)
+{
+    struct sigaction action;
+    struct bench_ctx ctx = {NULL, NULL, 0, 0, 0};
+    FILE *folded = NULL;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = profile_signal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigaction(SIGPROF, &action, NULL);
+    NOT_NULL(profile_samples = malloc(sizeof(*profile_samples) * PROFILE_MAX_SAMPLES));
+    NOT_NULL(ctx.s1 = aligned_alloc(64, profile_size + 64));
+    NOT_NULL(ctx.s2 = aligned_alloc(64, profile_size + 64));
+    if (profile_folded_path != NULL) {
+        folded = fopen(profile_folded_path, "w");
+        if (folded == NULL) {
+            printf("\x1B[31m--> Could not open [%s]: %s\n\e[0m", profile_folded_path,
+                   strerror(errno));
+            exit(1);
+        }
+    }
+    measure_pin();
+    printf("--> Sampling every %d us of CPU time (or every kernel tick) for %d ms per function, "
+           "size %lu\n\n",
+           PROFILE_INTERVAL_US, profile_ms, profile_size);
+    for (unsigned int i = 0; i < NB_BENCHS; i++) {
+        if (is_selected(BENCHS[i].funcname, ac, av)) {
+            run_profile(&BENCHS[i], &ctx, folded);
+        }
+    }
+    if (folded != NULL) {
+        fclose(folded);
+        printf("--> Folded stacks saved to [%s]\n", profile_folded_path);
+    }
+    signal(SIGPROF, SIG_DFL);
+    free(profile_samples);
+    free(ctx.s1);
+    free(ctx.s2);
+}
+
+/*
+
+Watch mode
+Keep the library loaded and wait for it to be rebuilt: on every build, reload it
+and rerun in forked workers only the suites of the functions whose code changed
+
+*/
+
+#define WATCH_QUIET_MS 50
+
+int watch_mode = 0;
+
+// Wait until the library is written or moved in place, then until its directory is quiet
+static int watch_wait(int fd, const char *base)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int seen = 0;
+
+    while (poll(&pfd, 1, seen ? WATCH_QUIET_MS : -1) > 0) {
+        ssize_t len = read(fd, buf, sizeof(buf));
+        for (char *p = buf; len > 0 && p < buf + len;) {
+            const struct inotify_event *e = (const struct inotify_event *)p;
+            seen |= e->len > 0 && strcmp(e->name, base) == 0;
+            p += sizeof(*e) + e->len;
+        }
+    }
+    return seen;
+}
+
+// Number of selected functions whose fingerprint changed, -1 if the library does not load
+static int watch_reload(struct library *lib, uint64_t *hashes, char **changed, int ac, char **av)
+{
+    int nb = 0;
+
+    if (lib->handle != NULL) {
+        dlclose(lib->handle);
+    }
+    lib->handle = dlopen(lib->path, RTLD_NOW | RTLD_DEEPBIND);
+    if (lib->handle == NULL) {
+        printf("\x1B[31m--> Could not reload: %s\n\e[0m", dlerror());
+        // The symbols pointed into the closed handle: forget them, and the next load reruns all
+        memset(lib->syms, 0, sizeof(lib->syms));
+        memset(hashes, 0, NB_SYMBOLS * sizeof(*hashes));
+        use_library(0);
+        return -1;
+    }
+    for (unsigned int i = 0; i < NB_SYMBOLS; i++) {
+        lib->syms[i] = dlsym(lib->handle, SYMBOLS[i].name);
+        uint64_t hash = symbol_fingerprint(lib, i);
+        if (hash != hashes[i] && is_selected(SYMBOLS[i].name, ac, av)) {
+            changed[nb++] = SYMBOLS[i].name;
+        }
+        hashes[i] = hash;
+    }
+    use_library(0);
+    return nb;
+}
+
+int run_watch(int ac, char **av)
+{
+    struct library *lib = &libraries[0];
+    uint64_t hashes[NB_SYMBOLS];
+    char *changed[NB_SYMBOLS];
+    char *dir = strdup(lib->path);
+    char *base = strrchr(dir, '/');
+    int fd = inotify_init1(IN_CLOEXEC);
+
+    assert(fd >= 0);
+    // Linkers often write a new file and rename it: watch the directory, not the file
+    if (base == NULL) {
+        base = dir;
+        dir = ".";
+    } else {
+        *base++ = '\0';
+    }
+    if (inotify_add_watch(fd, *dir ? dir : "/", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        printf("\x1B[31m--> Could not watch [%s]: %s\n\e[0m", *dir ? dir : "/", strerror(errno));
+        return 1;
+    }
+    if (jobs == 0) {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    for (unsigned int i = 0; i < NB_SYMBOLS; i++) {
+        hashes[i] = symbol_fingerprint(lib, i);
+    }
+    run_isolated(ac, av);
+    show_score();
+    for (;;) {
+        printf("\n--> Watching [%s] for a new build...\n", lib->path);
+        fflush(stdout);
+        if (!watch_wait(fd, base)) {
+            continue;
+        }
+        uint64_t start = measure_now_ns();
+        int nb = watch_reload(lib, hashes, changed, ac, av);
+        if (nb == 0) {
+            printf("--> Rebuilt, no selected function changed\n");
+        }
+        if (nb <= 0) {
+            continue;
+        }
+        printf("--> Rebuilt, rerunning:");
+        for (int i = 0; i < nb; i++) {
+            printf(" [%s]", changed[i]);
+        }
+        printf("\n\n");
+        success = 0;
+        failure = 0;
+        run_isolated(nb, changed);
+        show_score();
+        printf("--> Done %.1f ms after the reload\n", (measure_now_ns() - start) / 1e6);
+    }
+}
+
+static const struct option OPTIONS[] = {
+    {"fast", no_argument, NULL, 'f'},
+    {"lib", required_argument, NULL, 'i'},
+    {"preload", optional_argument, NULL, 'P'},
+    {"replay", required_argument, NULL, 'R'},
+    {"abi", no_argument, NULL, 'A'},
+    {"profile", optional_argument, NULL, 'G'},
+    {"profile-size", required_argument, NULL, 'H'},
+    {"folded", required_argument, NULL, 'D'},
+    {"replay-calls", required_argument, NULL, 'Q'},
+    {"cmp", required_argument, NULL, 'r'},
+    {"arena-align", required_argument, NULL, 'a'},
+    {"arena-offset", required_argument, NULL, 'o'},
+    {"arena-redzone", required_argument, NULL, 'y'},
+    {"jobs", optional_argument, NULL, 'j'},
+    {"results", required_argument, NULL, 'k'},
+    {"watch", no_argument, NULL, 'U'},
+    {"bench", no_argument, NULL, 'b'},
+    {"bench-max", required_argument, NULL, 'M'},
+    {"cache", optional_argument, NULL, 'K'},
+    {"bench-time", required_argument, NULL, 'T'},
+    {"samples", required_argument, NULL, 'S'},
+    {"warmup", required_argument, NULL, 'W'},
+    {"cpu", required_argument, NULL, 'C'},
+    {"noise", required_argument, NULL, 'N'},
+    {"baseline", required_argument, NULL, 'B'},
+    {"save-baseline", required_argument, NULL, 'O'},
+    {"threshold", required_argument, NULL, 't'},
+    {"perf", no_argument, NULL, 'p'},
+    {"bandwidth", optional_argument, NULL, 'w'},
+    {"bandwidth-size", required_argument, NULL, 'z'},
+    {"bandwidth-time", required_argument, NULL, 'Z'},
+    {"mapped", optional_argument, NULL, 'V'},
+    {"mapped-size", required_argument, NULL, 'Y'},
+    {"mapped-hints", required_argument, NULL, 'I'},
+    {"latency", optional_argument, NULL, 'l'},
+    {"latency-samples", required_argument, NULL, 's'},
+    {"guard", optional_argument, NULL, 'g'},
+    {"crossover", optional_argument, NULL, 'u'},
+    {"crossover-jump", required_argument, NULL, 'J'},
+    {"complexity", optional_argument, NULL, 'x'},
+    {"complexity-cap", required_argument, NULL, 'X'},
+    {"fuzz", optional_argument, NULL, 'F'},
+    {"exhaustive", optional_argument, NULL, 'E'},
+    {"seed", required_argument, NULL, 'e'},
+    {"matrix", optional_argument, NULL, 'm'},
+    {"matrix-large", required_argument, NULL, 'L'},
+    {"matrix-csv", required_argument, NULL, 'c'},
+    {NULL, 0, NULL, 0},
+};
+
+static void check_option(int valid, const struct option *option)
+{
+    if (!valid) {
+        option_error(option->name, optarg ? optarg : "", NULL);
+    }
+}
+
+void parse_options(int ac, char **av)
+{
+    int opt;
+    int index;
+
+    while ((opt = getopt_long(ac, av, "", OPTIONS, &index)) != -1) {
+        switch (opt) {
+        case 'f':
+            fast_mode = 1;
+            break;
+        case 'i':
+            add_library(optarg);
+            break;
+        case 'A':
+            abi_mode = 1;
+            break;
+        case 'G':
+            profile_ms = optarg ? atoi(optarg) : 2000;
+            check_option(profile_ms > 0, &OPTIONS[index]);
+            break;
+        case 'H':
+            profile_size = strtoul(optarg, NULL, 0);
+            check_option(profile_size > 0, &OPTIONS[index]);
+            break;
+        case 'D':
+            profile_folded_path = optarg;
+            break;
+        case 'R':
+            replay_path = optarg;
+            break;
+        case 'Q':
+            replay_max = strtoul(optarg, NULL, 0);
+            check_option(replay_max > 0, &OPTIONS[index]);
+            break;
+        case 'P':
+            preload_runs = optarg ? atoi(optarg) : 10;
+            check_option(preload_runs > 0 && preload_runs <= MEASURE_MAX_SAMPLES, &OPTIONS[index]);
+            break;
+        case 'r':
+            parse_contracts(optarg);
+            break;
+        case 'a':
+            test_arena.align = strtoul(optarg, NULL, 0);
+            check_option(test_arena.align > 0 && (test_arena.align & (test_arena.align - 1)) == 0,
+                         &OPTIONS[index]);
+            break;
+        case 'o':
+            test_arena.offset = strtoul(optarg, NULL, 0);
+            break;
+        case 'y':
+            test_arena.redzone = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            jobs = optarg ? atoi(optarg) : sysconf(_SC_NPROCESSORS_ONLN);
+            check_option(jobs > 0, &OPTIONS[index]);
+            break;
+        case 'U':
+            watch_mode = 1;
+            break;
+        case 'k':
+            result_cache_path = optarg;
+            break;
+        case 'b':
+            bench_mode = 1;
+            break;
+        case 'K':
+            if (optarg) {
+                parse_cache_modes(optarg);
+            } else {
+                cache_modes = (1 << NB_CACHE_MODES) - 1;
+            }
+            break;
+        case 'M':
+            bench_max = strtoul(optarg, NULL, 0);
+            check_option(bench_max > 0, &OPTIONS[index]);
+            break;
+        case 'T':
+            measure_target_ns = strtoul(optarg, NULL, 0) * 1000 * 1000;
+            break;
+        case 'S':
+            measure_samples = atoi(optarg);
+            check_option(measure_samples > 0 && measure_samples <= MEASURE_MAX_SAMPLES,
+                         &OPTIONS[index]);
+            break;
+        case 'W':
+            measure_warmup_ns = strtoul(optarg, NULL, 0) * 1000 * 1000;
+            break;
+        case 'C':
+            measure_cpu = atoi(optarg);
+            check_option(measure_cpu >= 0 && measure_cpu < CPU_SETSIZE, &OPTIONS[index]);
+            break;
+        case 'N':
+            measure_noise = atof(optarg) / 100;
+            break;
+        case 'B':
+            baseline_path = optarg;
+            break;
+        case 'O':
+            baseline_save_path = optarg;
+            break;
+        case 't':
+            baseline_threshold = atof(optarg) / 100;
+            break;
+        case 'p':
+            perf_mode = 1;
+            break;
+        case 'w':
+            bandwidth_threads = optarg ? atoi(optarg) : sysconf(_SC_NPROCESSORS_ONLN);
+            check_option(bandwidth_threads > 0 && bandwidth_threads <= BANDWIDTH_MAX_THREADS,
+                         &OPTIONS[index]);
+            break;
+        case 'z':
+            bandwidth_size = strtoul(optarg, NULL, 0);
+            check_option(bandwidth_size >= 4096, &OPTIONS[index]);
+            break;
+        case 'Z':
+            bandwidth_time_ns = strtoul(optarg, NULL, 0) * 1000 * 1000;
+            break;
+        case 'V':
+            mapped_mode = 1;
+            mapped_path = optarg;
+            break;
+        case 'Y':
+            mapped_size = strtoul(optarg, NULL, 0);
+            check_option(mapped_size > 0, &OPTIONS[index]);
+            break;
+        case 'I':
+            parse_mapped_hints(optarg);
+            break;
+        case 'l':
+            latency_mode = 1;
+            latency_max = optarg ? strtoul(optarg, NULL, 0) : latency_max;
+            break;
+        case 's':
+            latency_samples = strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            guard_max_len = optarg ? atoi(optarg) : 256;
+            check_option(guard_max_len >= 0, &OPTIONS[index]);
+            break;
+        case 'u':
+            crossover_mode = 1;
+            crossover_max = optarg ? strtoul(optarg, NULL, 0) : crossover_max;
+            check_option(crossover_max >= 64, &OPTIONS[index]);
+            break;
+        case 'J':
+            crossover_jump = atof(optarg) / 100;
+            break;
+        case 'x':
+            complexity_mode = 1;
+            complexity_max = optarg ? strtoul(optarg, NULL, 0) : complexity_max;
+            check_option(complexity_max >= 1024, &OPTIONS[index]);
+            break;
+        case 'X':
+            complexity_cap_ns = strtoul(optarg, NULL, 0) * 1000 * 1000;
+            break;
+        case 'F':
+            fuzz_cases = optarg ? strtoull(optarg, NULL, 0) : 1000000;
+            check_option(fuzz_cases > 0, &OPTIONS[index]);
+            break;
+        case 'E':
+            exhaustive_threads = optarg ? atoi(optarg) : sysconf(_SC_NPROCESSORS_ONLN);
+            check_option(exhaustive_threads > 0 && exhaustive_threads <= BANDWIDTH_MAX_THREADS,
+                         &OPTIONS[index]);
+            break;
+        case 'e':
+            fuzz_seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'm':
+            matrix_mode = 1;
+            matrix_max = optarg ? strtoul(optarg, NULL, 0) : matrix_max;
+            check_option(matrix_max >= 64, &OPTIONS[index]);
+            break;
+        case 'L':
+            matrix_large = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            if ((matrix_csv = fopen(optarg, "w")) == NULL) {
+                option_error(OPTIONS[index].name, optarg, strerror(errno));
+            }
+            break;
+        default:
+            exit(1);
+        }
+    }
+}
+
+// The test suites selected on the command line
+void run_suites(int ac, char **av)
+{
+    if (jobs > 0)
+        run_isolated(ac - optind, av + optind);
+    else if (optind == ac)
+        run_tests();
+    else
+        for (int i = optind; i < ac; i++)
+            chose_specific_test(av[i]);
+}
+
+// Run the mode picked on the command line with the current library
+void run_modes(int ac, char **av)
+{
+    if (bench_mode || latency_mode || bandwidth_threads || mapped_mode) {
+        // Several libraries are ranked on their correctness as well as on their speed
+        if (bench_mode && nb_libraries > 1)
+            run_suites(ac, av);
+        if (bench_mode)
+            run_benchmarks(ac - optind, av + optind);
+        if (latency_mode)
+            run_latencies(ac - optind, av + optind);
+        if (bandwidth_threads)
+            run_bandwidths(ac - optind, av + optind);
+        if (mapped_mode)
+            run_mappeds(ac - optind, av + optind);
+    } else if (profile_ms)
+        run_profiles(ac - optind, av + optind);
+    else if (abi_mode)
+        run_abis(ac - optind, av + optind);
+    else if (replay_path != NULL)
+        run_replays(ac - optind, av + optind);
+    else if (guard_max_len >= 0)
+        run_guard_tests(ac - optind, av + optind);
+    else if (matrix_mode)
+        run_matrices(ac - optind, av + optind);
+    else if (fuzz_cases)
+        run_fuzzers(ac - optind, av + optind);
+    else if (crossover_mode)
+        run_crossovers(ac - optind, av + optind);
+    else if (complexity_mode)
+        run_complexities(ac - optind, av + optind);
+    else if (exhaustive_threads)
+        run_exhaustives(ac - optind, av + optind);
+    else
+        run_suites(ac, av);
+}
+
+void print_library_scores(void)
+{
+    printf("\n|------------| Scores per library |------------|\n\n");
+    for (int i = 0; i < nb_libraries; i++) {
+        const struct library *lib = &libraries[i];
+        int total = lib->success + lib->failure;
+        printf("\t%-30s Success: [\x1B[32m%d\e[0m] Failure: [\x1B[31m%d\e[0m] Rate: [%.2f%%]\n",
+               lib->path, lib->success, lib->failure, total ? 100.0 * lib->success / total : 0);
+    }
+}
+
+int main(int ac, char **av)
+{
+    parse_options(ac, av);
+    setup();
+    if (nb_libraries == 0) {
+        add_library("./libasm.so");
+    }
+    if (preload_runs) {
+        return run_preload(ac - optind, av + optind) != 0;
+    }
+    if (result_cache_path != NULL) {
+        result_cache_open(result_cache_path);
+    }
+    for (int i = 0; i < nb_libraries; i++) {
+        load_library(&libraries[i]);
+    }
+    if (watch_mode) {
+        use_library(0);
+        return run_watch(ac - optind, av + optind);
+    }
+    for (int i = 0; i < nb_libraries; i++) {
+        int before_success = success;
+        int before_failure = failure;
+        use_library(i);
+        run_modes(ac, av);
+        libraries[i].success = success - before_success;
+        libraries[i].failure = failure - before_failure;
+    }
+    for (int i = 0; i < nb_libraries; i++) {
+        unload_library(&libraries[i]);
+    }
+    result_cache_close();
+    if (bench_mode || latency_mode || bandwidth_threads || mapped_mode) {
+        if (bench_mode) {
+            baseline_report();
+            if (nb_libraries > 1) {
+                print_library_scores();
+            }
+            print_rankings();
+        }
+        return regressions != 0;
+    }
+    if (nb_libraries > 1) {
+        print_library_scores();
+    }
     show_score();
     return 0;
 }
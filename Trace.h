@@ -0,0 +1,67 @@
+/**
+ * Trace.h
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/*
+Call traces
+Written by TraceShim.so and replayed by ./tests --replay:
+a header followed by one fixed size record per call
+*/
+
+#define TRACE_MAGIC "MLCTRACE"
+#define TRACE_VERSION 1
+#define TRACE_NONE UINT32_MAX
+
+enum trace_func {
+    TRACE_STRLEN,
+    TRACE_STRCHR,
+    TRACE_STRRCHR,
+    TRACE_MEMSET,
+    TRACE_MEMCPY,
+    TRACE_STRCMP,
+    TRACE_MEMMOVE,
+    TRACE_STRNCMP,
+    TRACE_STRCASECMP,
+    TRACE_STRSTR,
+    TRACE_STRPBRK,
+    TRACE_STRCSPN,
+    TRACE_NB_FUNCS,
+};
+
+struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+// Lengths are clamped to TRACE_NONE - 1, positions are TRACE_NONE when nothing is found
+struct trace_record {
+    uint8_t func;
+    uint8_t align1;     // address of the first pointer argument modulo 64
+    uint8_t align2;     // same for the second one
+    uint8_t c;          // character argument of strchr, strrchr and memset
+    uint32_t len1;      // length of the first string, or size of the buffers
+    uint32_t len2;      // length of the second string, needle or set
+    uint32_t n;         // bound of strncmp
+    uint32_t result;    // position of the match or of the first difference,
+                        // or distance from source to destination of memmove
+};
+
+#endif
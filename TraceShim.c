@@ -0,0 +1,395 @@
+/**
+ * TraceShim.c
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "Trace.h"
+
+/*
+Trace shim
+Preloaded in a program, it records every call to the functions of Trace.h
+in the file named by MINILIBC_TRACE (trace.bin by default), then calls glibc.
+Build it with -fno-builtin -fno-tree-loop-distribute-patterns so that gcc
+does not turn the loops below back into calls to the functions they replace
+*/
+
+#define TRACE_BUFFER 4096
+
+static struct trace_record records[TRACE_BUFFER];
+static size_t nb_records = 0;
+static int trace_fd = -1;
+static int resolving = 0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t (*real_strlen)(const char *) = NULL;
+static char *(*real_strchr)(const char *, int) = NULL;
+static char *(*real_strrchr)(const char *, int) = NULL;
+static void *(*real_memset)(void *, int, size_t) = NULL;
+static void *(*real_memcpy)(void *, const void *, size_t) = NULL;
+static int (*real_strcmp)(const char *, const char *) = NULL;
+static void *(*real_memmove)(void *, const void *, size_t) = NULL;
+static int (*real_strncmp)(const char *, const char *, size_t) = NULL;
+static int (*real_strcasecmp)(const char *, const char *) = NULL;
+static char *(*real_strstr)(const char *, const char *) = NULL;
+static char *(*real_strpbrk)(const char *, const char *) = NULL;
+static size_t (*real_strcspn)(const char *, const char *) = NULL;
+
+// dlsym may itself call the functions it is resolving: they fall back on these
+static size_t naive_strlen(const char *s)
+{
+    size_t i = 0;
+
+    while (s[i] != '\0') {
+        i++;
+    }
+    return i;
+}
+
+// Copies backward when the destination is after the source, so it serves memmove too
+static void *naive_memmove(void *dst, const void *src, size_t n)
+{
+    volatile char *d = dst;
+    const char *s = src;
+
+    if (d < s) {
+        for (size_t i = 0; i < n; i++) {
+            d[i] = s[i];
+        }
+    } else {
+        for (size_t i = n; i > 0; i--) {
+            d[i - 1] = s[i - 1];
+        }
+    }
+    return dst;
+}
+
+static char *naive_strchr(const char *s, int c)
+{
+    for (;; s++) {
+        if (*s == (char)c) {
+            return (char *)s;
+        }
+        if (*s == '\0') {
+            return NULL;
+        }
+    }
+}
+
+static char *naive_strrchr(const char *s, int c)
+{
+    const char *found = NULL;
+
+    for (;; s++) {
+        if (*s == (char)c) {
+            found = s;
+        }
+        if (*s == '\0') {
+            return (char *)found;
+        }
+    }
+}
+
+static size_t naive_strcspn(const char *s, const char *reject)
+{
+    size_t i = 0;
+
+    while (s[i] != '\0' && naive_strchr(reject, s[i]) == NULL) {
+        i++;
+    }
+    return i;
+}
+
+static char *naive_strpbrk(const char *s, const char *accept)
+{
+    s += naive_strcspn(s, accept);
+    return *s != '\0' ? (char *)s : NULL;
+}
+
+static char *naive_strstr(const char *haystack, const char *needle)
+{
+    size_t len = naive_strlen(needle);
+
+    for (; *haystack != '\0' || len == 0; haystack++) {
+        size_t i = 0;
+        while (i < len && haystack[i] == needle[i]) {
+            i++;
+        }
+        if (i == len) {
+            return (char *)haystack;
+        }
+    }
+    return NULL;
+}
+
+static void *naive_memset(void *dst, int c, size_t n)
+{
+    volatile char *d = dst;
+
+    for (size_t i = 0; i < n; i++) {
+        d[i] = c;
+    }
+    return dst;
+}
+
+static size_t naive_prefix(const char *s1, const char *s2, size_t n, int fold)
+{
+    size_t i = 0;
+
+    while (i < n && s1[i] != '\0') {
+        int c1 = (unsigned char)s1[i];
+        int c2 = (unsigned char)s2[i];
+        if (fold ? tolower(c1) != tolower(c2) : c1 != c2) {
+            break;
+        }
+        i++;
+    }
+    return i;
+}
+
+static int naive_compare(const char *s1, const char *s2, size_t n, int fold)
+{
+    size_t i = naive_prefix(s1, s2, n, fold);
+
+    if (i == n) {
+        return 0;
+    }
+    if (fold) {
+        return tolower((unsigned char)s1[i]) - tolower((unsigned char)s2[i]);
+    }
+    return (unsigned char)s1[i] - (unsigned char)s2[i];
+}
+
+static void trace_resolve(void)
+{
+    resolving = 1;
+    real_strlen = dlsym(RTLD_NEXT, "strlen");
+    real_strchr = dlsym(RTLD_NEXT, "strchr");
+    real_strrchr = dlsym(RTLD_NEXT, "strrchr");
+    real_memset = dlsym(RTLD_NEXT, "memset");
+    real_memcpy = dlsym(RTLD_NEXT, "memcpy");
+    real_strcmp = dlsym(RTLD_NEXT, "strcmp");
+    real_memmove = dlsym(RTLD_NEXT, "memmove");
+    real_strncmp = dlsym(RTLD_NEXT, "strncmp");
+    real_strcasecmp = dlsym(RTLD_NEXT, "strcasecmp");
+    real_strstr = dlsym(RTLD_NEXT, "strstr");
+    real_strpbrk = dlsym(RTLD_NEXT, "strpbrk");
+    real_strcspn = dlsym(RTLD_NEXT, "strcspn");
+    resolving = 0;
+}
+
+// Called with trace_lock held
+static void trace_flush(void)
+{
+    const char *data = (const char *)records;
+    size_t left = nb_records * sizeof(*records);
+
+    while (left > 0) {
+        ssize_t written = write(trace_fd, data, left);
+        if (written <= 0) {
+            break;
+        }
+        data += written;
+        left -= written;
+    }
+    nb_records = 0;
+}
+
+// Records buffered before a fork belong to the parent
+static void trace_forked(void)
+{
+    nb_records = 0;
+    pthread_mutex_init(&trace_lock, NULL);
+}
+
+__attribute__((constructor)) static void trace_open(void)
+{
+    struct trace_header header = {TRACE_MAGIC, TRACE_VERSION, sizeof(struct trace_record)};
+    const char *path = getenv("MINILIBC_TRACE");
+
+    if (real_strlen == NULL) {
+        trace_resolve();
+    }
+    trace_fd = open(path ? path : "trace.bin", O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (trace_fd < 0) {
+        return;
+    }
+    // Processes of a same run append to the same trace
+    if (lseek(trace_fd, 0, SEEK_END) == 0
+        && write(trace_fd, &header, sizeof(header)) != sizeof(header)) {
+        close(trace_fd);
+        trace_fd = -1;
+        return;
+    }
+    pthread_atfork(NULL, NULL, trace_forked);
+}
+
+__attribute__((destructor)) static void trace_close(void)
+{
+    if (trace_fd < 0) {
+        return;
+    }
+    pthread_mutex_lock(&trace_lock);
+    trace_flush();
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static uint32_t clamp(size_t len)
+{
+    return len < TRACE_NONE ? len : TRACE_NONE - 1;
+}
+
+static uint32_t position(const char *found, const char *s)
+{
+    return found == NULL ? TRACE_NONE : clamp(found - s);
+}
+
+static void trace(int func, const void *p1, const void *p2, int c, size_t len1, size_t len2,
+                  size_t n, uint32_t result)
+{
+    if (trace_fd < 0) {
+        return;
+    }
+    pthread_mutex_lock(&trace_lock);
+    struct trace_record *r = &records[nb_records++];
+    r->func = func;
+    r->align1 = (uintptr_t)p1 & 63;
+    r->align2 = (uintptr_t)p2 & 63;
+    r->c = c;
+    r->len1 = clamp(len1);
+    r->len2 = clamp(len2);
+    r->n = clamp(n);
+    r->result = result;
+    if (nb_records == TRACE_BUFFER) {
+        trace_flush();
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+#define RESOLVE(name, fallback) \
+    do { \
+        if (real_##name == NULL) { \
+            if (resolving) \
+                return fallback; \
+            trace_resolve(); \
+        } \
+    } while (0)
+
+size_t strlen(const char *s)
+{
+    RESOLVE(strlen, naive_strlen(s));
+    size_t len = real_strlen(s);
+    trace(TRACE_STRLEN, s, NULL, 0, len, 0, 0, clamp(len));
+    return len;
+}
+
+char *strchr(const char *s, int c)
+{
+    RESOLVE(strchr, naive_strchr(s, c));
+    char *found = real_strchr(s, c);
+    trace(TRACE_STRCHR, s, NULL, c, real_strlen(s), 0, 0, position(found, s));
+    return found;
+}
+
+char *strrchr(const char *s, int c)
+{
+    RESOLVE(strrchr, naive_strrchr(s, c));
+    char *found = real_strrchr(s, c);
+    trace(TRACE_STRRCHR, s, NULL, c, real_strlen(s), 0, 0, position(found, s));
+    return found;
+}
+
+void *memset(void *s, int c, size_t n)
+{
+    RESOLVE(memset, naive_memset(s, c, n));
+    trace(TRACE_MEMSET, s, NULL, c, n, 0, 0, TRACE_NONE);
+    return real_memset(s, c, n);
+}
+
+void *memcpy(void *restrict dst, const void *restrict src, size_t n)
+{
+    RESOLVE(memcpy, naive_memmove(dst, src, n));
+    trace(TRACE_MEMCPY, dst, src, 0, n, 0, 0, TRACE_NONE);
+    return real_memcpy(dst, src, n);
+}
+
+int strcmp(const char *s1, const char *s2)
+{
+    RESOLVE(strcmp, naive_compare(s1, s2, SIZE_MAX, 0));
+    trace(TRACE_STRCMP, s1, s2, 0, real_strlen(s1), real_strlen(s2), 0,
+          clamp(naive_prefix(s1, s2, SIZE_MAX, 0)));
+    return real_strcmp(s1, s2);
+}
+
+void *memmove(void *dst, const void *src, size_t n)
+{
+    RESOLVE(memmove, naive_memmove(dst, src, n));
+    ptrdiff_t distance = (char *)dst - (const char *)src;
+    int overlap = distance > -(ptrdiff_t)n && distance < (ptrdiff_t)n;
+    trace(TRACE_MEMMOVE, dst, src, 0, n, 0, 0, overlap ? (uint32_t)(int32_t)distance : TRACE_NONE);
+    return real_memmove(dst, src, n);
+}
+
+int strncmp(const char *s1, const char *s2, size_t n)
+{
+    RESOLVE(strncmp, naive_compare(s1, s2, n, 0));
+    trace(TRACE_STRNCMP, s1, s2, 0, strnlen(s1, n), strnlen(s2, n), n,
+          clamp(naive_prefix(s1, s2, n, 0)));
+    return real_strncmp(s1, s2, n);
+}
+
+int strcasecmp(const char *s1, const char *s2)
+{
+    RESOLVE(strcasecmp, naive_compare(s1, s2, SIZE_MAX, 1));
+    trace(TRACE_STRCASECMP, s1, s2, 0, real_strlen(s1), real_strlen(s2), 0,
+          clamp(naive_prefix(s1, s2, SIZE_MAX, 1)));
+    return real_strcasecmp(s1, s2);
+}
+
+char *strstr(const char *haystack, const char *needle)
+{
+    RESOLVE(strstr, naive_strstr(haystack, needle));
+    char *found = real_strstr(haystack, needle);
+    trace(TRACE_STRSTR, haystack, needle, 0, real_strlen(haystack), real_strlen(needle), 0,
+          position(found, haystack));
+    return found;
+}
+
+char *strpbrk(const char *s, const char *accept)
+{
+    RESOLVE(strpbrk, naive_strpbrk(s, accept));
+    char *found = real_strpbrk(s, accept);
+    trace(TRACE_STRPBRK, s, accept, 0, real_strlen(s), real_strlen(accept), 0, position(found, s));
+    return found;
+}
+
+size_t strcspn(const char *s, const char *reject)
+{
+    RESOLVE(strcspn, naive_strcspn(s, reject));
+    size_t len = real_strcspn(s, reject);
+    trace(TRACE_STRCSPN, s, reject, 0, real_strlen(s), real_strlen(reject), 0, clamp(len));
+    return len;
+}